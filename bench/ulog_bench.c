@@ -0,0 +1,362 @@
+/* Microbenchmarks of the logging hot paths.
+ *
+ * Every case is timed in samples of a batch of operations, a sample is the mean
+ * cost of one operation of its batch. Percentiles are taken over the samples,
+ * so that a regression in the tail shows up even when the mean does not move.
+ *
+ * usage: ulog_bench [max_threads]
+ */
+#define LOG_LOCAL_LEVEL ULOG_DEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "ulog.h"
+
+#define SAMPLES         20000
+#define THREAD_SAMPLES  5000
+#define TAG_COUNT_MAX   500
+#define DUMP_SIZE       1500
+
+ULOG_DEFINE_TAG(TAG, "bench");
+
+static const char *s_string_tag = "bench_str";
+static const char *s_rule_tag = "bench_rule.x";
+static char s_tags[TAG_COUNT_MAX][16];
+static unsigned char s_dump[DUMP_SIZE];
+
+static atomic_size_t s_null_bytes;
+
+static void null_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    (void) ctx;
+    (void) level;
+    (void) buf;
+    atomic_fetch_add_explicit(&s_null_bytes, len, memory_order_relaxed);
+}
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, size_t count)
+{
+    double sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += samples[i];
+    }
+    qsort(samples, count, sizeof(double), &compare_double);
+    printf("%-44s %10.1f %10.1f %10.1f %10.1f\n", name, sum / count,
+           samples[count / 2], samples[count * 99 / 100], samples[count * 999 / 1000]);
+}
+
+typedef void (*bench_op_t)(size_t i);
+
+static void run_samples(bench_op_t op, size_t batch, double *samples, size_t count)
+{
+    size_t i = 0;
+    for (size_t n = 0; n < count; ++n) {
+        uint64_t start = now_ns();
+        for (size_t end = i + batch; i < end; ++i) {
+            op(i);
+        }
+        samples[n] = (double) (now_ns() - start) / batch;
+    }
+}
+
+static void run(const char *name, bench_op_t op, size_t batch)
+{
+    static double samples[SAMPLES];
+    // warm up the caches and the thread context
+    run_samples(op, batch, samples, SAMPLES / 10);
+    run_samples(op, batch, samples, SAMPLES);
+    report(name, samples, SAMPLES);
+}
+
+/* -- cases ---------------------------------------------------------------- */
+
+static void op_disabled_local(size_t i)
+{
+    ULOGV(TAG, "disabled at compile time %u", (unsigned) i);
+}
+
+static void op_disabled_desc(size_t i)
+{
+    ULOGI(TAG, "disabled by the tag level %u", (unsigned) i);
+}
+
+static void op_disabled_string(size_t i)
+{
+    ULOGI(s_string_tag, "disabled by the tag level %u", (unsigned) i);
+}
+
+static void op_disabled_rule(size_t i)
+{
+    ULOGI(s_rule_tag, "disabled by a tag level rule %u", (unsigned) i);
+}
+
+#if CONFIG_LOG_SITES
+static void op_site_off(size_t i)
+{
+    ULOGE(TAG, "call site turned off %u", (unsigned) i);
+}
+#endif
+
+/* ULOG_LEVEL has no call site, so that the entries are not rate limited */
+static void op_enabled(size_t i)
+{
+    ULOG_LEVEL(ULOG_INFO, TAG, "enabled entry %u to the null sink", (unsigned) i);
+}
+
+static void op_keyword_filter(size_t i)
+{
+    ULOG_LEVEL(ULOG_INFO, TAG, "heartbeat %u", (unsigned) i);
+}
+
+static void op_backtrace_only(size_t i)
+{
+    ULOG_LEVEL(ULOG_DEBUG, TAG, "entry %u kept in the backtrace store", (unsigned) i);
+}
+
+#if CONFIG_LOG_RATE_LIMIT
+static void op_rate_limited(size_t i)
+{
+    ULOGI(TAG, "rate limited entry %u", (unsigned) i);
+}
+#endif
+
+static void op_fields_printf(size_t i)
+{
+    ULOG_LEVEL(ULOG_INFO, TAG, "entry len=%u peer=\"%s\"", (unsigned) i, "10.0.0.1");
+}
+
+static void op_fields_kv(size_t i)
+{
+    const ulog_kv_t fields[] = { ULOG_U32("len", i), ULOG_STR("peer", "10.0.0.1") };
+    ulog_write_kv(ULOG_INFO, TAG, "entry", fields, 2);
+}
+
+static char s_line[CONFIG_LOG_LINE_BUFFER_SIZE];
+
+#define LINE_FORMAT "I (%" PRIu32 ") %s: rx %u bytes from %s, crc %08x\n"
+
+static void op_format_libc(size_t i)
+{
+    snprintf(s_line, sizeof(s_line), LINE_FORMAT, (uint32_t) i, "bench", (unsigned) i & 0x3ff, "10.0.0.1",
+             (unsigned) i * 2654435761u);
+}
+
+static void op_format_ulog(size_t i)
+{
+    ulog_snprintf(s_line, sizeof(s_line), LINE_FORMAT, (uint32_t) i, "bench", (unsigned) i & 0x3ff, "10.0.0.1",
+                  (unsigned) i * 2654435761u);
+}
+
+/* UART whose transfers complete at once, for the cost of the copies and the swaps */
+static ulog_uart_sink_t *s_uart;
+static char s_uart_buffers[2][256];
+
+static void uart_start_tx(void *ctx, const void *buf, size_t len)
+{
+    (void) ctx;
+    (void) buf;
+    atomic_fetch_add_explicit(&s_null_bytes, len, memory_order_relaxed);
+    ulog_uart_sink_tx_done(s_uart);
+}
+
+static size_t s_tag_count;
+
+static void op_level_get(size_t i)
+{
+    volatile ulog_level_t level = ulog_level_get(s_tags[i % s_tag_count]);
+    (void) level;
+}
+
+static void op_hexdump(size_t i)
+{
+    (void) i;
+    ulog_buffer_hexdump_internal(TAG, s_dump, sizeof(s_dump), ULOG_INFO);
+}
+
+static void op_hexdump_block(size_t i)
+{
+    (void) i;
+    ulog_buffer_hexdump_block_internal(TAG, s_dump, sizeof(s_dump), ULOG_INFO);
+}
+
+/* -- contention ----------------------------------------------------------- */
+
+typedef struct {
+    pthread_barrier_t *barrier;
+    double samples[THREAD_SAMPLES];
+} thread_arg_t;
+
+static void *contention_thread(void *arg)
+{
+    thread_arg_t *thread_arg = (thread_arg_t *) arg;
+    pthread_barrier_wait(thread_arg->barrier);
+    run_samples(&op_enabled, 8, thread_arg->samples, THREAD_SAMPLES);
+    return NULL;
+}
+
+/* 1, 2, 4, ... then max_threads */
+static int next_thread_count(int threads, int max_threads)
+{
+    if (threads == max_threads) {
+        return max_threads + 1;
+    }
+    return threads * 2 < max_threads ? threads * 2 : max_threads;
+}
+
+static void run_contention(const char *mode, int max_threads)
+{
+    static double merged[THREAD_SAMPLES * 64];
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, threads);
+        pthread_t ids[64];
+        thread_arg_t *args = calloc(threads, sizeof(thread_arg_t));
+        for (int t = 0; t < threads; ++t) {
+            args[t].barrier = &barrier;
+            pthread_create(&ids[t], NULL, &contention_thread, &args[t]);
+        }
+        for (int t = 0; t < threads; ++t) {
+            pthread_join(ids[t], NULL);
+            memcpy(merged + t * THREAD_SAMPLES, args[t].samples, sizeof(args[t].samples));
+        }
+        ulog_async_flush();
+        char name[64];
+        snprintf(name, sizeof(name), "enabled, %s, %d thread%s", mode, threads, threads > 1 ? "s" : "");
+        report(name, merged, (size_t) threads * THREAD_SAMPLES);
+        free(args);
+        pthread_barrier_destroy(&barrier);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) {
+        max_threads = 1;
+    } else if (max_threads > 64) {
+        max_threads = 64;
+    }
+    for (size_t i = 0; i < TAG_COUNT_MAX; ++i) {
+        snprintf(s_tags[i], sizeof(s_tags[i]), "tag%u", (unsigned) i);
+    }
+    for (size_t i = 0; i < sizeof(s_dump); ++i) {
+        s_dump[i] = (unsigned char) (i * 7);
+    }
+
+    ulog_sink_remove(ULOG_SINK_CONSOLE);
+    ulog_sink_config_t null_sink = {
+        .write = &null_sink_write,
+        .level = ULOG_VERBOSE,
+    };
+    int null_sink_id = ulog_sink_add(&null_sink);
+
+    printf("%-44s %10s %10s %10s %10s\n", "ns/op", "mean", "p50", "p99", "p999");
+
+    ulog_level_set(TAG, ULOG_WARN);
+    ulog_level_set(s_string_tag, ULOG_WARN);
+    run("disabled, LOG_LOCAL_LEVEL", &op_disabled_local, 256);
+    run("disabled, tag level, ULOG_DEFINE_TAG", &op_disabled_desc, 256);
+    run("disabled, tag level, string tag", &op_disabled_string, 256);
+    ulog_level_set("bench_rule*", ULOG_WARN);
+    run("disabled, tag level rule, string tag", &op_disabled_rule, 256);
+
+#if CONFIG_LOG_SITES
+    ulog_sites_set(NULL, 0, 0, "call site turned off", ULOG_SITE_OFF);
+    run("disabled, call site turned off", &op_site_off, 256);
+#endif
+
+    ulog_level_set(TAG, ULOG_VERBOSE);
+    run("enabled, null sink", &op_enabled, 8);
+#if CONFIG_LOG_RATE_LIMIT
+    run("enabled, suppressed by the rate limit", &op_rate_limited, 256);
+#endif
+#if CONFIG_LOG_FILTER
+    ulog_filter_add("heartbeat", ULOG_FILTER_EXCLUDE);
+    run("enabled, dropped by a keyword filter", &op_keyword_filter, 64);
+    ulog_filter_clear();
+#endif
+#if CONFIG_LOG_BACKTRACE
+    ulog_sink_level_set(null_sink_id, ULOG_INFO);
+    run("enabled, backtrace store only", &op_backtrace_only, 8);
+    ulog_sink_level_set(null_sink_id, ULOG_VERBOSE);
+
+    // without the backtrace store, which takes every entry as text
+    ulog_backtrace_level_set(ULOG_NONE);
+#endif
+    run("2 fields, printf to the null sink", &op_fields_printf, 8);
+    run("2 fields, ULOG_KV text to the null sink", &op_fields_kv, 8);
+    ulog_sink_level_set(null_sink_id, ULOG_NONE);
+    null_sink.structured = true;
+    int structured_sink_id = ulog_sink_add(&null_sink);
+    run("2 fields, ULOG_KV CBOR to the null sink", &op_fields_kv, 8);
+    ulog_sink_remove(structured_sink_id);
+    ulog_sink_level_set(null_sink_id, ULOG_VERBOSE);
+#if CONFIG_LOG_BACKTRACE
+    ulog_backtrace_level_set(CONFIG_LOG_BACKTRACE_LEVEL);
+#endif
+
+    ulog_uart_sink_config_t uart_config = {
+        .start_tx = &uart_start_tx,
+        .buffers = { s_uart_buffers[0], s_uart_buffers[1] },
+        .buffer_size = sizeof(s_uart_buffers[0]),
+        .block = true,
+    };
+    s_uart = ulog_uart_sink_create(&uart_config);
+    ulog_sink_config_t uart_sink = {
+        .write = &ulog_uart_sink_write,
+        .ctx = s_uart,
+        .level = ULOG_VERBOSE,
+    };
+    ulog_sink_level_set(null_sink_id, ULOG_NONE);
+    int uart_sink_id = ulog_sink_add(&uart_sink);
+    run("enabled, DMA UART sink", &op_enabled, 8);
+    ulog_sink_remove(uart_sink_id);
+    ulog_uart_sink_flush(s_uart);
+    ulog_uart_sink_destroy(s_uart);
+    ulog_sink_level_set(null_sink_id, ULOG_VERBOSE);
+
+    run("format a line, libc snprintf", &op_format_libc, 64);
+    run("format a line, ulog_snprintf", &op_format_ulog, 64);
+
+    const size_t tag_counts[] = {1, 31, TAG_COUNT_MAX};
+    for (size_t n = 0; n < sizeof(tag_counts) / sizeof(tag_counts[0]); ++n) {
+        s_tag_count = tag_counts[n];
+        for (size_t i = 0; i < s_tag_count; ++i) {
+            ulog_level_set(s_tags[i], ULOG_INFO);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "ulog_level_get, %u tag%s", (unsigned) s_tag_count,
+                 s_tag_count > 1 ? "s" : "");
+        run(name, &op_level_get, 64);
+    }
+
+    run("hexdump 1500 bytes, line per entry", &op_hexdump, 1);
+    run("hexdump 1500 bytes, single entry", &op_hexdump_block, 1);
+
+    run_contention("sync", max_threads);
+    ulog_async_config_t async_config = ULOG_ASYNC_CONFIG_DEFAULT();
+    async_config.policy = ULOG_ASYNC_BLOCK;
+    if (ulog_async_start(&async_config)) {
+        run_contention("async", max_threads);
+    }
+    return 0;
+}
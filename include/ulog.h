@@ -8,7 +8,9 @@
 #define __ULOG_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <inttypes.h>
 #include "ulog_cfg.h"
 
@@ -31,6 +33,57 @@ typedef enum {
 
 typedef int (*vprintf_like_t)(const char *, va_list);
 
+/**
+ * @brief Maximum length of a tag defined with ULOG_DEFINE_TAG
+ */
+#define ULOG_TAG_NAME_MAX 30
+
+/**
+ * @brief Static descriptor of a tag defined with ULOG_DEFINE_TAG
+ *
+ * Descriptors are placed in the ulog_tags linker section, which ulog_level_set()
+ * walks to keep the level slot up to date. Reading the level of such a tag is a
+ * single load, without any cache or string comparison.
+ *
+ * The size is fixed to 32 bytes so that the section is a plain array, whatever
+ * extra alignment the compiler gives to each descriptor.
+ */
+typedef struct {
+    uint8_t level;                      /*!< Current log level of the tag (ulog_level_t) */
+    char name[ULOG_TAG_NAME_MAX + 1];   /*!< Zero terminated tag name */
+} __attribute__((aligned(32))) ulog_tag_desc_t;
+
+/** @cond */
+/* Bounds of the section, defined by the linker since its name is a C identifier.
+   Weak so that a program without any descriptor links, both are then NULL. */
+extern ulog_tag_desc_t __start_ulog_tags[] __attribute__((weak));
+extern ulog_tag_desc_t __stop_ulog_tags[] __attribute__((weak));
+
+#ifdef __cplusplus
+#define _ULOG_STATIC_ASSERT static_assert
+#else
+#define _ULOG_STATIC_ASSERT _Static_assert
+#endif
+/** @endcond */
+
+/**
+ * @brief Define a tag with a static level slot
+ *
+ * Defines `var` as a `const char *` pointing to the tag name, it can be used
+ * everywhere a tag string is expected, e.g. `ULOG_DEFINE_TAG(TAG, "wifi");`
+ * replaces `static const char *TAG = "wifi";`. Identical names defined in
+ * several files share the same level.
+ *
+ * @param var      name of the variable to define
+ * @param tag_name tag name, a string literal of at most ULOG_TAG_NAME_MAX characters
+ */
+#define ULOG_DEFINE_TAG(var, tag_name)                                                              \
+    _ULOG_STATIC_ASSERT(sizeof(tag_name) <= ULOG_TAG_NAME_MAX + 1, "tag name too long: " tag_name); \
+    static ulog_tag_desc_t var##_ulog_desc __attribute__((section("ulog_tags"), used)) = {          \
+        CONFIG_LOG_DEFAULT_LEVEL, tag_name                                                          \
+    };                                                                                              \
+    static const char *const var __attribute__((unused)) = var##_ulog_desc.name
+
 /**
  * @brief Default log level
  *
@@ -40,6 +93,15 @@ typedef int (*vprintf_like_t)(const char *, va_list);
  */
 extern ulog_level_t ulog_default_level;
 
+/**
+ * @brief Highest log level currently enabled for any tag
+ *
+ * Maintained by ulog_level_set(), it is an upper bound of the level of every tag
+ * (including the default level). Messages above it are rejected by ulog_enabled()
+ * without looking up the tag. Do not set this directly.
+ */
+extern ulog_level_t ulog_max_level;
+
 /**
  * @brief Set log level for given tag
  *
@@ -51,8 +113,26 @@ extern ulog_level_t ulog_default_level;
  * LOG_LOCAL_LEVEL to one of the ULOG_* values, before including
  * ulog.h in this file.
  *
+ * @note Entries above the compile time level of a file are removed from the build,
+ * format strings included. A group of files can share a level: define ULOG_MODULE
+ * to the name of the module, e.g. wifi, before including ulog.h, and define
+ * ULOG_TAG_LEVEL_wifi to a number from 0 (ULOG_NONE) to 5 (ULOG_VERBOSE) in
+ * ulog_cfg.h or on the command line. Modules without such a definition use
+ * CONFIG_LOG_MAXIMUM_LEVEL, LOG_LOCAL_LEVEL still takes precedence.
+ *
+ * @note At most 3/4 of CONFIG_LOG_TAG_TABLE_SIZE tags can be given their own
+ * level, and they must fit in CONFIG_LOG_TAG_POOL_SIZE bytes, a tag taking its
+ * length plus 10 bytes, rounded up to a multiple of 4. The call is ignored for a new tag once the table or the
+ * pool is full. Tags are not forgotten by ulog_level_set("*", level).
+ *
+ * @note A tag ending with '*', e.g. "net.*" or "drv_*", sets the level of every tag
+ * starting with what precedes the '*', unless the tag has a level of its own. The
+ * longest matching prefix wins. Rules are kept in a trie of CONFIG_LOG_LEVEL_RULE_NODES
+ * nodes, one per character not shared with another rule, and resolved once per tag:
+ * tags matching a rule take an entry of the table as well.
+ *
  * @param tag Tag of the log entries to enable. Must be a non-NULL zero terminated string.
- *            Value "*" resets log level for all tags to the given value.
+ *            Value "*" resets log level for all tags to the given value, and drops the rules.
  *
  * @param level  Selects log level to enable. Only logs at this and lower verbosity
  * levels will be shown.
@@ -62,6 +142,9 @@ void ulog_level_set(const char* tag, ulog_level_t level);
 /**
  * @brief Get log level for a given tag, can be used to avoid expensive log statements
  *
+ * Cached tags are looked up without taking the log lock, so this can be called
+ * concurrently from many threads.
+ *
  * @param tag Tag of the log to query current level. Must be a non-NULL zero terminated
  *            string.
  *
@@ -69,6 +152,48 @@ void ulog_level_set(const char* tag, ulog_level_t level);
  */
 ulog_level_t ulog_level_get(const char* tag);
 
+/**
+ * @brief Get the descriptor of a tag defined with ULOG_DEFINE_TAG
+ *
+ * @param tag Tag of the log entries.
+ *
+ * @return descriptor of the tag, or NULL if the tag was not defined with ULOG_DEFINE_TAG
+ */
+static inline ulog_tag_desc_t *ulog_tag_desc(const char* tag)
+{
+    uintptr_t offset = (uintptr_t) tag - (uintptr_t) __start_ulog_tags;
+    if (offset >= (uintptr_t) __stop_ulog_tags - (uintptr_t) __start_ulog_tags) {
+        return NULL;
+    }
+    // index the section rather than offsetting tag, so the compiler does not take
+    // the result for a pointer into the string literal passed as tag
+    return &__start_ulog_tags[offset / sizeof(ulog_tag_desc_t)];
+}
+
+/**
+ * @brief Check whether a message of given level and tag would be written
+ *
+ * This is the fast path used by the ULOGx macros before the timestamp and the
+ * arguments are evaluated, so that a disabled statement costs one comparison
+ * in the common case and a tag lookup otherwise.
+ *
+ * @param tag Tag of the log entry. Must be a non-NULL zero terminated string.
+ * @param level Level of the log entry.
+ *
+ * @return true if the log entry would be written
+ */
+static inline bool ulog_enabled(const char* tag, ulog_level_t level)
+{
+    if (level > (ulog_level_t) __atomic_load_n(&ulog_max_level, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    const ulog_tag_desc_t *desc = ulog_tag_desc(tag);
+    if (desc) {
+        return level <= (ulog_level_t) __atomic_load_n(&desc->level, __ATOMIC_RELAXED);
+    }
+    return level <= ulog_level_get(tag);
+}
+
 /**
  * @brief Set function used to output log entries
  *
@@ -85,13 +210,38 @@ ulog_level_t ulog_level_get(const char* tag);
  */
 vprintf_like_t ulog_set_vprintf(vprintf_like_t func);
 
+/**
+ * @brief Format a string like vsnprintf(), without the C library
+ *
+ * Entries are formatted with this function when CONFIG_LOG_VSNPRINTF is set. It does
+ * not allocate, takes little stack, has no locale and can be called from an interrupt.
+ * The flags "-+ #0", width and precision, '*' included, the length modifiers of
+ * <inttypes.h> and the conversions d, i, u, o, x, X, c, s, p and % are supported.
+ * Floating point conversions are passed to snprintf() one at a time, they are as
+ * reentrant as the C library. %n writes nothing, NULL strings are written as "(null)".
+ *
+ * @param buf    destination, always NUL terminated if size is not 0
+ * @param size   size of buf
+ * @param format printf format string
+ * @param args   arguments of the format
+ *
+ * @return length of the whole formatted string, also when it was truncated
+ */
+int ulog_vsnprintf(char *buf, size_t size, const char *format, va_list args);
+
+/**
+ * @brief Format a string like snprintf(), see ulog_vsnprintf()
+ */
+int ulog_snprintf(char *buf, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
 /**
  * @brief Function which returns timestamp to be used in log output
  *
  * This function is used in expansion of ULOGx macros.
  * In the 2nd stage bootloader, and at early application startup stage
  * this function uses CPU cycle counter as time source. Later when
- * FreeRTOS scheduler start running, it switches to FreeRTOS tick count.
+ * FreeRTOS scheduler start running, it switches to the system timer, which
+ * is the same on every core.
  *
  * For now, we ignore millisecond counter overflow.
  *
@@ -107,10 +257,14 @@ uint32_t ulog_timestamp(void);
  * 0 on startup, this can be set to the correct time with an SNTP sync,
  * or manually with standard POSIX time functions.
  *
+ * On Linux the time is printed as "YYYY-MM-DD HH:MM:SS" followed by
+ * CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION digits of fraction. The date and time
+ * are only formatted again when the second changes.
+ *
  * Currently, this will not get used in logging from binary blobs
  * (i.e. Wi-Fi & Bluetooth libraries), these will still print the RTOS tick time.
  *
- * @return timestamp, in "HH:MM:SS.sss"
+ * @return timestamp, in "HH:MM:SS.sss", valid until the next call from the same thread
  */
 char* ulog_system_timestamp(void);
 
@@ -145,13 +299,55 @@ void ulog_writev(ulog_level_t level, const char* tag, const char* format, va_lis
 
 /** @cond */
 
+/* Same as ulog_write(), but the tag level is not checked again. Used by the ULOGx
+   macros once ulog_enabled() has accepted the message. */
+void ulog_write_unchecked(ulog_level_t level, const char* tag, const char* format, ...) __attribute__ ((format (printf, 3, 4)));
+
 #include "ulog_internal.h"
+#include "ulog_async.h"
+#include "ulog_binary.h"
+#include "ulog_backtrace.h"
+#include "ulog_sink.h"
+#include "ulog_isr.h"
+#include "ulog_site.h"
+#include "ulog_ratelimit.h"
+#include "ulog_stats.h"
+#include "ulog_profile.h"
+#include "ulog_kv.h"
+#include "ulog_filter.h"
+#include "ulog_uart.h"
+#include "ulog_flash.h"
+#ifdef __linux__
+#include "ulog_linux.h"
+#endif
+
+/* ULOG_MODULE_LEVEL(module, fallback) is ULOG_TAG_LEVEL_<module> if it is defined
+   as a number, fallback otherwise: the name pastes to one of the _ULOG_PROBE_n,
+   which insert the level before fallback. */
+#define _ULOG_PROBE_0 ~, 0
+#define _ULOG_PROBE_1 ~, 1
+#define _ULOG_PROBE_2 ~, 2
+#define _ULOG_PROBE_3 ~, 3
+#define _ULOG_PROBE_4 ~, 4
+#define _ULOG_PROBE_5 ~, 5
+#define _ULOG_CAT_(a, b) a ## b
+#define _ULOG_CAT(a, b) _ULOG_CAT_(a, b)
+#define _ULOG_SECOND_(first, second, ...) second
+#define _ULOG_SECOND(...) _ULOG_SECOND_(__VA_ARGS__)
+#define _ULOG_PROBE(value, fallback) _ULOG_SECOND(_ULOG_CAT(_ULOG_PROBE_, value), fallback, ~)
+#define ULOG_MODULE_LEVEL(module, fallback) _ULOG_PROBE(_ULOG_CAT(ULOG_TAG_LEVEL_, module), fallback)
 
-#ifndef LOG_LOCAL_LEVEL
 #ifndef BOOTLOADER_BUILD
-#define LOG_LOCAL_LEVEL  CONFIG_LOG_MAXIMUM_LEVEL
+#define _ULOG_DEFAULT_LOCAL_LEVEL  CONFIG_LOG_MAXIMUM_LEVEL
 #else
-#define LOG_LOCAL_LEVEL  CONFIG_BOOTLOADER_LOG_LEVEL
+#define _ULOG_DEFAULT_LOCAL_LEVEL  CONFIG_BOOTLOADER_LOG_LEVEL
+#endif
+
+#ifndef LOG_LOCAL_LEVEL
+#ifdef ULOG_MODULE
+#define LOG_LOCAL_LEVEL  ULOG_MODULE_LEVEL(ULOG_MODULE, _ULOG_DEFAULT_LOCAL_LEVEL)
+#else
+#define LOG_LOCAL_LEVEL  _ULOG_DEFAULT_LOCAL_LEVEL
 #endif
 #endif
 
@@ -212,6 +408,31 @@ void ulog_writev(ulog_level_t level, const char* tag, const char* format, va_lis
         } \
     } while(0)
 
+/**
+ * @brief Dump a buffer to the log at specified level, as a single log entry.
+ *
+ * Same lines as ULOG_BUFFER_HEXDUMP(), but the whole dump is passed to the sinks
+ * in one write, after a single prefix:
+ *
+ *      W (195) log_example: 28 bytes:
+ *      0x3ffb4280   45 53 50 33 32 20 69 73  20 67 72 65 61 74 2c 20  |ESP32 is great, |
+ *      0x3ffb4290   77 6f 72 6b 69 6e 67 20  61 6c 6f 6e 67 20 77 69  |working along wi|
+ *
+ * The text is built in a heap buffer, the dump falls back to ULOG_BUFFER_HEXDUMP()
+ * if it cannot be allocated.
+ *
+ * @param tag description tag
+ * @param buffer Pointer to the buffer array
+ * @param buff_len length of buffer in bytes
+ * @param level level of the log
+ */
+#define ULOG_BUFFER_HEXDUMP_BLOCK( tag, buffer, buff_len, level ) \
+    do { \
+        if ( LOG_LOCAL_LEVEL >= (level) ) { \
+            ulog_buffer_hexdump_block_internal( tag, buffer, buff_len, level); \
+        } \
+    } while(0)
+
 /**
  * @brief Log a buffer of hex bytes at Info level
  *
@@ -281,6 +502,23 @@ void ulog_writev(ulog_level_t level, const char* tag, const char* format, va_lis
 #define LOG_FORMAT(letter, format)  LOG_COLOR_ ## letter #letter " (%" PRIu32 ") %s: " format LOG_RESET_COLOR "\n"
 #define LOG_SYSTEM_TIME_FORMAT(letter, format)  LOG_COLOR_ ## letter #letter " (%s) %s: " format LOG_RESET_COLOR "\n"
 
+/* Same layouts, the color and the letter being passed as the first arguments */
+#define LOG_LEVEL_FORMAT(format)  "%s%c (%" PRIu32 ") %s: " format LOG_RESET_COLOR "\n"
+#define LOG_LEVEL_SYSTEM_TIME_FORMAT(format)  "%s%c (%s) %s: " format LOG_RESET_COLOR "\n"
+
+extern const char *const ulog_level_colors[ULOG_VERBOSE + 1];
+extern const char ulog_level_letters[ULOG_VERBOSE + 2];
+
+static inline const char *ulog_level_color(ulog_level_t level)
+{
+    return ulog_level_colors[level <= ULOG_VERBOSE ? level : ULOG_INFO];
+}
+
+static inline char ulog_level_letter(ulog_level_t level)
+{
+    return ulog_level_letters[level <= ULOG_VERBOSE ? level : ULOG_INFO];
+}
+
 /** @endcond */
 
 /// macro to output logs in startup code, before heap allocator and syscalls have been initialized.
@@ -330,17 +568,17 @@ void ulog_writev(ulog_level_t level, const char* tag, const char* format, va_lis
 
 #ifndef BOOTLOADER_BUILD
 #if defined(__cplusplus) && (__cplusplus >  201703L)
-#define ULOGE( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_ERROR,   tag, format __VA_OPT__(,) __VA_ARGS__)
-#define ULOGW( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_WARN,    tag, format __VA_OPT__(,) __VA_ARGS__)
-#define ULOGI( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_INFO,    tag, format __VA_OPT__(,) __VA_ARGS__)
-#define ULOGD( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_DEBUG,   tag, format __VA_OPT__(,) __VA_ARGS__)
-#define ULOGV( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_VERBOSE, tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ULOGE( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_ERROR,   tag, format, ULOG_WRITE_LETTER(ULOG_ERROR,   E, tag, format __VA_OPT__(,) __VA_ARGS__))
+#define ULOGW( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_WARN,    tag, format, ULOG_WRITE_LETTER(ULOG_WARN,    W, tag, format __VA_OPT__(,) __VA_ARGS__))
+#define ULOGI( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_INFO,    tag, format, ULOG_WRITE_LETTER(ULOG_INFO,    I, tag, format __VA_OPT__(,) __VA_ARGS__))
+#define ULOGD( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_DEBUG,   tag, format, ULOG_WRITE_LETTER(ULOG_DEBUG,   D, tag, format __VA_OPT__(,) __VA_ARGS__))
+#define ULOGV( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_VERBOSE, tag, format, ULOG_WRITE_LETTER(ULOG_VERBOSE, V, tag, format __VA_OPT__(,) __VA_ARGS__))
 #else // !(defined(__cplusplus) && (__cplusplus >  201703L))
-#define ULOGE( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_ERROR,   tag, format, ##__VA_ARGS__)
-#define ULOGW( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_WARN,    tag, format, ##__VA_ARGS__)
-#define ULOGI( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_INFO,    tag, format, ##__VA_ARGS__)
-#define ULOGD( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_DEBUG,   tag, format, ##__VA_ARGS__)
-#define ULOGV( tag, format, ... ) ULOG_LEVEL_LOCAL(ULOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#define ULOGE( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_ERROR,   tag, format, ULOG_WRITE_LETTER(ULOG_ERROR,   E, tag, format, ##__VA_ARGS__))
+#define ULOGW( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_WARN,    tag, format, ULOG_WRITE_LETTER(ULOG_WARN,    W, tag, format, ##__VA_ARGS__))
+#define ULOGI( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_INFO,    tag, format, ULOG_WRITE_LETTER(ULOG_INFO,    I, tag, format, ##__VA_ARGS__))
+#define ULOGD( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_DEBUG,   tag, format, ULOG_WRITE_LETTER(ULOG_DEBUG,   D, tag, format, ##__VA_ARGS__))
+#define ULOGV( tag, format, ... ) ULOG_LOCAL_CHECKED(ULOG_VERBOSE, tag, format, ULOG_WRITE_LETTER(ULOG_VERBOSE, V, tag, format, ##__VA_ARGS__))
 #endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
 #else
 
@@ -386,50 +624,99 @@ void ulog_writev(ulog_level_t level, const char* tag, const char* format, va_lis
  * @see ``printf``
  */
 #if defined(__cplusplus) && (__cplusplus >  201703L)
-#if CONFIG_LOG_TIMESTAMP_SOURCE_RTOS
 #define ULOG_LEVEL(level, tag, format, ...) do {                     \
-        if (level==ULOG_ERROR )          { ulog_write(ULOG_ERROR,      tag, LOG_FORMAT(E, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_WARN )      { ulog_write(ULOG_WARN,       tag, LOG_FORMAT(W, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_DEBUG )     { ulog_write(ULOG_DEBUG,      tag, LOG_FORMAT(D, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_VERBOSE )   { ulog_write(ULOG_VERBOSE,    tag, LOG_FORMAT(V, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else                                { ulog_write(ULOG_INFO,       tag, LOG_FORMAT(I, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
+        if (ulog_enabled(tag, level)) { ULOG_LEVEL_UNCHECKED(level, tag, format __VA_OPT__(,) __VA_ARGS__); } \
     } while(0)
-#elif CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#else
 #define ULOG_LEVEL(level, tag, format, ...) do {                     \
-        if (level==ULOG_ERROR )          { ulog_write(ULOG_ERROR,      tag, LOG_SYSTEM_TIME_FORMAT(E, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_WARN )      { ulog_write(ULOG_WARN,       tag, LOG_SYSTEM_TIME_FORMAT(W, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_DEBUG )     { ulog_write(ULOG_DEBUG,      tag, LOG_SYSTEM_TIME_FORMAT(D, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else if (level==ULOG_VERBOSE )   { ulog_write(ULOG_VERBOSE,    tag, LOG_SYSTEM_TIME_FORMAT(V, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
-        else                                { ulog_write(ULOG_INFO,       tag, LOG_SYSTEM_TIME_FORMAT(I, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__); } \
+        if (ulog_enabled(tag, level)) { ULOG_LEVEL_UNCHECKED(level, tag, format, ##__VA_ARGS__); } \
     } while(0)
+#endif
+
+/** @cond */
+/* ULOG_WRITE_LETTER() writes an entry of a level known at compile time by its letter,
+   ULOG_LEVEL_UNCHECKED() one of any level, its prefix being looked up at run time.
+   Both are a single call with a single format string. */
+#if CONFIG_LOG_BINARY
+#if defined(__cplusplus) && (__cplusplus >  201703L)
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) do {                                        \
+        static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;               \
+        ulog_write_binary_unchecked(level, tag, _ulog_fmt __VA_OPT__(,) __VA_ARGS__);              \
+    } while(0)
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) ULOG_LEVEL_UNCHECKED(level, tag, format __VA_OPT__(,) __VA_ARGS__)
+#else
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) do {                                        \
+        static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;               \
+        ulog_write_binary_unchecked(level, tag, _ulog_fmt, ##__VA_ARGS__);                         \
+    } while(0)
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) ULOG_LEVEL_UNCHECKED(level, tag, format, ##__VA_ARGS__)
+#endif
+#elif defined(__cplusplus) && (__cplusplus >  201703L)
+#if CONFIG_LOG_TIMESTAMP_SOURCE_RTOS
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_FORMAT(letter, format), ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__)
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_LEVEL_FORMAT(format), ulog_level_color(level), ulog_level_letter(level), \
+                             ulog_timestamp(), tag __VA_OPT__(,) __VA_ARGS__)
+#elif CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_SYSTEM_TIME_FORMAT(letter, format), ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__)
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_LEVEL_SYSTEM_TIME_FORMAT(format), ulog_level_color(level), ulog_level_letter(level), \
+                             ulog_system_timestamp(), tag __VA_OPT__(,) __VA_ARGS__)
 #endif //CONFIG_LOG_TIMESTAMP_SOURCE_xxx
 #else // !(defined(__cplusplus) && (__cplusplus >  201703L))
 #if CONFIG_LOG_TIMESTAMP_SOURCE_RTOS
-#define ULOG_LEVEL(level, tag, format, ...) do {                     \
-        if (level==ULOG_ERROR )          { ulog_write(ULOG_ERROR,      tag, LOG_FORMAT(E, format), ulog_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_WARN )      { ulog_write(ULOG_WARN,       tag, LOG_FORMAT(W, format), ulog_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_DEBUG )     { ulog_write(ULOG_DEBUG,      tag, LOG_FORMAT(D, format), ulog_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_VERBOSE )   { ulog_write(ULOG_VERBOSE,    tag, LOG_FORMAT(V, format), ulog_timestamp(), tag, ##__VA_ARGS__); } \
-        else                                { ulog_write(ULOG_INFO,       tag, LOG_FORMAT(I, format), ulog_timestamp(), tag, ##__VA_ARGS__); } \
-    } while(0)
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_FORMAT(letter, format), ulog_timestamp(), tag, ##__VA_ARGS__)
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_LEVEL_FORMAT(format), ulog_level_color(level), ulog_level_letter(level), \
+                             ulog_timestamp(), tag, ##__VA_ARGS__)
 #elif CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
-#define ULOG_LEVEL(level, tag, format, ...) do {                     \
-        if (level==ULOG_ERROR )          { ulog_write(ULOG_ERROR,      tag, LOG_SYSTEM_TIME_FORMAT(E, format), ulog_system_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_WARN )      { ulog_write(ULOG_WARN,       tag, LOG_SYSTEM_TIME_FORMAT(W, format), ulog_system_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_DEBUG )     { ulog_write(ULOG_DEBUG,      tag, LOG_SYSTEM_TIME_FORMAT(D, format), ulog_system_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==ULOG_VERBOSE )   { ulog_write(ULOG_VERBOSE,    tag, LOG_SYSTEM_TIME_FORMAT(V, format), ulog_system_timestamp(), tag, ##__VA_ARGS__); } \
-        else                                { ulog_write(ULOG_INFO,       tag, LOG_SYSTEM_TIME_FORMAT(I, format), ulog_system_timestamp(), tag, ##__VA_ARGS__); } \
-    } while(0)
+#define ULOG_WRITE_LETTER(level, letter, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_SYSTEM_TIME_FORMAT(letter, format), ulog_system_timestamp(), tag, ##__VA_ARGS__)
+#define ULOG_LEVEL_UNCHECKED(level, tag, format, ...) \
+        ulog_write_unchecked(level, tag, LOG_LEVEL_SYSTEM_TIME_FORMAT(format), ulog_level_color(level), ulog_level_letter(level), \
+                             ulog_system_timestamp(), tag, ##__VA_ARGS__)
 #endif //CONFIG_LOG_TIMESTAMP_SOURCE_xxx
-#endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
+#endif // CONFIG_LOG_BINARY
+
+/* Checks of the ULOGx macros around the statements passed after format. With
+   CONFIG_LOG_SITES or CONFIG_LOG_RATE_LIMIT, every expansion is a call site, see
+   ulog_site_enabled() and ulog_site_take(). */
+#if CONFIG_LOG_SITES || CONFIG_LOG_RATE_LIMIT
+#if CONFIG_LOG_RATE_LIMIT
+#define _ULOG_SITE_TAKE(site, level, tag) ulog_site_take(site, level, tag)
+#else
+#define _ULOG_SITE_TAKE(site, level, tag) true
+#endif
+#define ULOG_LOCAL_CHECKED(level, tag, format, ...) do {             \
+        if ( LOG_LOCAL_LEVEL >= (level) ) { \
+            static ulog_site_t _ulog_site _ULOG_SITE_SECTION = ULOG_SITE_INIT(level, format); \
+            if ( ulog_site_enabled(&_ulog_site, level, tag) && _ULOG_SITE_TAKE(&_ulog_site, level, tag) ) { \
+                __VA_ARGS__; \
+            } \
+        } \
+    } while(0)
+#else
+#define ULOG_LOCAL_CHECKED(level, tag, format, ...) do {             \
+        if ( LOG_LOCAL_LEVEL >= (level) && ulog_enabled(tag, level) ) { \
+            __VA_ARGS__; \
+        } \
+    } while(0)
+#endif
+/** @endcond */
 
 /** runtime macro to output logs at a specified level. Also check the level with ``LOG_LOCAL_LEVEL``.
+ *
+ * With CONFIG_LOG_RATE_LIMIT, every expansion is a call site with its own token
+ * bucket, see ``ulog_site_take``. With CONFIG_LOG_SITES, it can be turned on and off
+ * at run time, see ``ulog_sites_set``.
  *
  * @see ``printf``, ``ULOG_LEVEL``
  */
-#define ULOG_LEVEL_LOCAL(level, tag, format, ...) do {               \
-        if ( LOG_LOCAL_LEVEL >= level ) ULOG_LEVEL(level, tag, format, ##__VA_ARGS__); \
-    } while(0)
+#define ULOG_LEVEL_LOCAL(level, tag, format, ...) \
+        ULOG_LOCAL_CHECKED(level, tag, format, ULOG_LEVEL_UNCHECKED(level, tag, format, ##__VA_ARGS__))
 
 
 /**
@@ -0,0 +1,76 @@
+#ifndef __ULOG_ASYNC_H__
+#define __ULOG_ASYNC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief What a producer does when its ring buffer is full
+ */
+typedef enum {
+    ULOG_ASYNC_DROP,    /*!< Drop the message and count it, the caller never waits */
+    ULOG_ASYNC_BLOCK,   /*!< Wait for the drain task to make room */
+} ulog_async_policy_t;
+
+/**
+ * @brief Configuration of the asynchronous output
+ */
+typedef struct {
+    size_t ring_size;               /*!< Size in bytes of the ring buffer of each thread, rounded up to a power of 2 */
+    ulog_async_policy_t policy;     /*!< Behavior when a ring buffer is full */
+} ulog_async_config_t;
+
+/**
+ * @brief Default configuration of the asynchronous output
+ */
+#define ULOG_ASYNC_CONFIG_DEFAULT() {                       \
+        .ring_size = CONFIG_LOG_ASYNC_RING_SIZE,            \
+        .policy = CONFIG_LOG_ASYNC_BLOCK_WHEN_FULL ? ULOG_ASYNC_BLOCK : ULOG_ASYNC_DROP, \
+    }
+
+/**
+ * @brief Start the asynchronous output
+ *
+ * Once started, log entries are formatted into a ring buffer owned by the calling
+ * thread, and a background drain task writes them to the output function set with
+ * ulog_set_vprintf(), in batches. The output function is then called from the
+ * drain task, and also from the threads calling ulog_async_flush(), writing an
+ * entry too long for a ring buffer, or logging without a log context, e.g. when
+ * it could not be allocated. Batches of queued entries are never written by two
+ * threads at once. Entries of different threads are written in the order they
+ * were queued in, by a monotonic microsecond clock, within every pass of the
+ * drain task.
+ *
+ * @param config configuration, or NULL to use ULOG_ASYNC_CONFIG_DEFAULT()
+ *
+ * @return true if the drain task is running, false if it could not be created or
+ *         if the platform has no background task support
+ */
+bool ulog_async_start(const ulog_async_config_t *config);
+
+/**
+ * @brief Write out all log entries pending in the ring buffers
+ *
+ * Can be called from any thread, e.g. before a reset, the entries are written
+ * from the calling thread. On Linux this is also done at process exit. The counts of the entries suppressed by the rate limit are
+ * written first, see ulog_suppressed_flush().
+ */
+void ulog_async_flush(void);
+
+/**
+ * @brief Number of log entries dropped because a ring buffer was full
+ *
+ * @return drop counter, since the asynchronous output was started
+ */
+uint32_t ulog_async_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_ASYNC_H__ */
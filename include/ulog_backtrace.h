@@ -0,0 +1,99 @@
+#ifndef __ULOG_BACKTRACE_H__
+#define __ULOG_BACKTRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Log entry read back from the backtrace store
+ */
+typedef struct {
+    uint32_t seq;           /*!< Sequence number, increases by one for every stored entry */
+    uint32_t timestamp;     /*!< Time the entry was stored, in milliseconds (ulog_timestamp()) */
+    ulog_level_t level;     /*!< Level of the entry */
+    const char *text;       /*!< Formatted entry, not zero terminated, truncated to the slot size */
+    size_t len;             /*!< Length of text */
+} ulog_backtrace_record_t;
+
+/**
+ * @brief Callback of ulog_backtrace_foreach()
+ *
+ * @return true to continue, false to stop the iteration
+ */
+typedef bool (*ulog_backtrace_cb_t)(const ulog_backtrace_record_t *record, void *arg);
+
+/**
+ * @brief Set the maximum level of the entries kept in the backtrace store
+ *
+ * The backtrace store keeps the latest entries in RAM which is not initialized at
+ * startup, so that they can still be read after a reset. It is written without
+ * taking any lock, the oldest entries are overwritten.
+ *
+ * Entries still need to pass the level of their tag, see ulog_level_set().
+ *
+ * With CONFIG_LOG_LAZY_FORMAT, entries which no sink takes are stored as binary
+ * records (see ulog_set_binary_output()) and only formatted when they are read.
+ * String arguments are then truncated to CONFIG_LOG_BINARY_STRING_MAX characters.
+ *
+ * @param level ULOG_NONE disables the store
+ */
+void ulog_backtrace_level_set(ulog_level_t level);
+
+/**
+ * @brief Call cb for the latest entries of the backtrace store, oldest first
+ *
+ * This can be called at any time, including after a reset and concurrently with
+ * logging: entries overwritten while they are read are skipped.
+ *
+ * @param count maximum number of entries, 0 for all of them
+ * @param cb    function called for every entry
+ * @param arg   argument passed to cb
+ *
+ * @return number of entries passed to cb
+ */
+size_t ulog_backtrace_foreach(size_t count, ulog_backtrace_cb_t cb, void *arg);
+
+/**
+ * @brief Call cb for the entries of the backtrace store matching all the given criteria, oldest first
+ *
+ * The time and level of every entry are checked before it is read, its tag before a
+ * binary record is formatted. The tag of a formatted entry is read from its prefix,
+ * see LOG_FORMAT(). Use ulog_flash_sink_query() for the entries stored in flash.
+ *
+ * Usage, the errors of "wifi" of the last ten minutes:
+ * ``ulog_query(ulog_timestamp() - 600000, UINT32_MAX, ULOG_ERROR, "wifi", cb, NULL)``
+ *
+ * @param from_ts first time, in milliseconds (ulog_timestamp())
+ * @param to_ts   last time, UINT32_MAX for the latest entries
+ * @param level   most verbose level, e.g. ULOG_WARN for the errors and warnings
+ * @param tag     tag of the entries, NULL for any tag
+ * @param cb      function called for every entry
+ * @param arg     argument passed to cb
+ *
+ * @return number of entries passed to cb
+ */
+size_t ulog_query(uint32_t from_ts, uint32_t to_ts, ulog_level_t level, const char *tag,
+                  ulog_backtrace_cb_t cb, void *arg);
+
+/**
+ * @brief Write the latest entries of the backtrace store with the output function
+ *
+ * @param count maximum number of entries, 0 for all of them
+ */
+void ulog_backtrace_dump(size_t count);
+
+/**
+ * @brief Remove all entries from the backtrace store
+ */
+void ulog_backtrace_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_BACKTRACE_H__ */
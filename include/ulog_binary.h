@@ -0,0 +1,102 @@
+#ifndef __ULOG_BINARY_H__
+#define __ULOG_BINARY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Function used to output binary log records
+ */
+typedef void (*ulog_binary_output_t)(const void *data, size_t len);
+
+/** @cond */
+#define ULOG_BINARY_SYNC            0xa5    // first byte of every record
+#define ULOG_BINARY_LEVEL_MASK      0x07
+#define ULOG_BINARY_FMT_INLINE      0x08    // format is a string in the record, not an offset in ulog_fmt
+#define ULOG_BINARY_TAG_INLINE      0x10    // tag is a string in the record, not an index in ulog_tags
+#define ULOG_BINARY_TRUNCATED       0x20    // the arguments did not fit in the record
+/** @endcond */
+
+/**
+ * @brief Set function used to output binary log records
+ *
+ * Binary records are written by ULOG_BINARY and ulog_write_binary(). A record is
+ * laid out as follows, multi-byte fields in the byte order of the target:
+ *
+ *      u8   ULOG_BINARY_SYNC
+ *      u8   level | flags (ULOG_BINARY_xxx)
+ *      u16  total length of the record, header included
+ *      u32  timestamp, in milliseconds (ulog_timestamp())
+ *      u32  offset of the format in the ulog_fmt section, or zero terminated format with ULOG_BINARY_FMT_INLINE
+ *      u16  index of the tag in the ulog_tags section, or zero terminated tag with ULOG_BINARY_TAG_INLINE
+ *      ...  arguments, packed without padding in the order of the format: int, long, long long,
+ *           size_t, ptrdiff_t, intmax_t and pointers with their native size, floating point values
+ *           as double, strings as zero terminated copies
+ *
+ * tools/ulog_decode.py rebuilds the text from the records and the ELF file of the firmware.
+ *
+ * By default records are written to stdout.
+ *
+ * @param func new function used for output
+ *
+ * @return old function used for output
+ */
+ulog_binary_output_t ulog_set_binary_output(ulog_binary_output_t func);
+
+/**
+ * @brief Write a binary record into the log
+ *
+ * Nothing is formatted: the format and the arguments are recorded as is. The format
+ * should be a string literal, only formats placed in the ulog_fmt section by
+ * ULOG_BINARY are encoded as an offset.
+ */
+void ulog_write_binary(ulog_level_t level, const char *tag, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
+
+/**
+ * @brief Write a binary record into the log, va_list variant
+ * @see ulog_write_binary()
+ */
+void ulog_writev_binary(ulog_level_t level, const char *tag, const char *format, va_list args);
+
+/** @cond */
+// bounds of the section, see __start_ulog_tags
+extern const char __start_ulog_fmt[] __attribute__((weak));
+extern const char __stop_ulog_fmt[] __attribute__((weak));
+
+void ulog_write_binary_unchecked(ulog_level_t level, const char *tag, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
+/** @endcond */
+
+/**
+ * @brief Macro to output a binary log record at a specified level
+ *
+ * The format is placed in the ulog_fmt section and is not formatted at runtime.
+ *
+ * @param level level of the output log.
+ * @param tag tag of the log, which can be used to change the log level by ``ulog_level_set`` at runtime.
+ * @param format format of the output log. See ``printf``
+ * @param ... variables to be replaced into the log. See ``printf``
+ */
+#if defined(__cplusplus) && (__cplusplus >  201703L)
+#define ULOG_BINARY(level, tag, format, ...) do {                                                  \
+        if (LOG_LOCAL_LEVEL >= (level) && ulog_enabled(tag, level)) {                              \
+            static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;           \
+            ulog_write_binary_unchecked(level, tag, _ulog_fmt __VA_OPT__(,) __VA_ARGS__);          \
+        }} while(0)
+#else // !(defined(__cplusplus) && (__cplusplus >  201703L))
+#define ULOG_BINARY(level, tag, format, ...) do {                                                  \
+        if (LOG_LOCAL_LEVEL >= (level) && ulog_enabled(tag, level)) {                              \
+            static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;           \
+            ulog_write_binary_unchecked(level, tag, _ulog_fmt, ##__VA_ARGS__);                     \
+        }} while(0)
+#endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_BINARY_H__ */
@@ -0,0 +1,50 @@
+#ifndef __ULOG_FILTER_H__
+#define __ULOG_FILTER_H__
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Effect of a keyword filter
+ */
+typedef enum {
+    ULOG_FILTER_INCLUDE,    /*!< Entries must contain one of the include patterns */
+    ULOG_FILTER_EXCLUDE,    /*!< Entries containing the pattern are dropped */
+} ulog_filter_mode_t;
+
+/**
+ * @brief Add a keyword filter
+ *
+ * A pattern is searched in the message of the text entries, the part after the
+ * "tag: " prefix, and may contain '*' for any sequence of characters and '?' for any
+ * character. An entry is written if it contains one of the include patterns, if any,
+ * and none of the exclude patterns.
+ *
+ * Filters are first applied to the format of the entry: when the pattern is found in
+ * its literal text, or when the format has no conversion, the verdict does not depend
+ * on the arguments and is taken without formatting the entry. The verdict is
+ * cached per format, in CONFIG_LOG_FILTER_CACHE_SIZE slots. Other entries are
+ * formatted and matched afterwards.
+ *
+ * Structured, binary and interrupt entries are not filtered.
+ *
+ * @param pattern pattern of at most CONFIG_LOG_FILTER_PATTERN_MAX - 1 characters, truncated otherwise
+ * @param mode    ULOG_FILTER_INCLUDE or ULOG_FILTER_EXCLUDE
+ *
+ * @return false if CONFIG_LOG_FILTER_MAX filters are already set
+ */
+bool ulog_filter_add(const char *pattern, ulog_filter_mode_t mode);
+
+/**
+ * @brief Remove all keyword filters
+ */
+void ulog_filter_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_FILTER_H__ */
@@ -0,0 +1,168 @@
+#ifndef __ULOG_FLASH_H__
+#define __ULOG_FLASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Header of every block written by a flash sink
+ *
+ * Blocks follow each other in the sectors of the partition, 4-byte aligned. A
+ * block never spans two sectors. Fields are in the byte order of the writer.
+ *
+ * The header indexes the entries of the block, read from their prefix (see
+ * LOG_FORMAT()) when the block is stored, so that ulog_flash_sink_query() skips the
+ * blocks that cannot match without reading their payload. Lines without such a
+ * prefix continue the previous entry, those at the start of the block are an entry
+ * of unknown level, tag and time: they set every level bit and the whole time range,
+ * but no tag bit, since such entries only match queries without a tag. An entry
+ * without a timestamp in milliseconds, e.g. with the system time, also sets the whole
+ * time range.
+ */
+typedef struct {
+    uint32_t magic;         /*!< ULOG_FLASH_MAGIC */
+    uint32_t seq;           /*!< Sequence number, increases by one with every block */
+    uint32_t first_ts;      /*!< Time of the oldest entry of the block, in milliseconds (ulog_timestamp()) */
+    uint32_t last_ts;       /*!< Time of the newest entry of the block */
+    uint16_t text_len;      /*!< Length of the entries of the block */
+    uint16_t len;           /*!< Length of the payload after the header, the entries as is if equal to text_len */
+    uint8_t levels;         /*!< Bit n is set if the block holds entries of level n (ulog_level_t) */
+    uint8_t reserved[3];
+    uint32_t tags[4];       /*!< Bloom filter of the tags of the entries, two bits per tag */
+    uint32_t crc;           /*!< CRC-32 of the header up to this field and of the payload */
+} ulog_flash_header_t;
+
+#define ULOG_FLASH_MAGIC 0x324c4755  // "UGL2" in little endian, "UGLF" blocks had no index
+
+/**
+ * @brief Configuration of a flash sink
+ *
+ * The functions are called with offsets relative to the start of the partition.
+ * They return false on error.
+ */
+typedef struct {
+    bool (*read)(void *ctx, uint32_t offset, void *buf, size_t len);            /*!< Read from the partition */
+    bool (*program)(void *ctx, uint32_t offset, const void *buf, size_t len);   /*!< Program erased bytes */
+    bool (*erase)(void *ctx, uint32_t offset, size_t len);                      /*!< Erase whole sectors, to 0xff */
+    void *ctx;                  /*!< Argument passed to the functions */
+    uint32_t partition_size;    /*!< Size of the partition, a multiple of sector_size */
+    uint32_t sector_size;       /*!< Size of the erase unit */
+    size_t block_size;          /*!< Entries buffered in RAM before being compressed, at most sector_size minus the header */
+    uint32_t flush_period_ms;   /*!< Maximum time an entry stays in RAM, 0 to wait for a full block */
+} ulog_flash_sink_config_t;
+
+/**
+ * @brief Default configuration of a flash sink, without the functions and the partition
+ */
+#define ULOG_FLASH_SINK_CONFIG_DEFAULT() {                          \
+        .block_size = CONFIG_LOG_FLASH_SINK_BLOCK_SIZE,             \
+        .flush_period_ms = CONFIG_LOG_FLASH_SINK_FLUSH_PERIOD_MS,   \
+    }
+
+typedef struct ulog_flash_sink ulog_flash_sink_t;
+
+/**
+ * @brief Create a sink storing the entries in a raw flash partition
+ *
+ * Entries are copied into a block in RAM. Once full, or once its first entry is older
+ * than the flush period, the block is compressed with LZ4 (block format) and
+ * appended to the partition with a ulog_flash_header_t. The sectors are used in turn,
+ * the oldest one being erased when the partition is full, so that they wear evenly.
+ *
+ * Only the poll function and ulog_flash_sink_flush() access the flash: register the
+ * sink with both write and poll functions, the drain task of the asynchronous output
+ * then does the compression, erase and program calls. A second block takes the
+ * entries meanwhile, when both are full the entries are dropped and counted.
+ *
+ *      ulog_flash_sink_t *flash = ulog_flash_sink_create(&config);
+ *      ulog_sink_config_t sink = {
+ *          .write = &ulog_flash_sink_write,
+ *          .poll = &ulog_flash_sink_poll,
+ *          .ctx = flash,
+ *          .level = ULOG_INFO,
+ *      };
+ *      ulog_sink_add(&sink);
+ *
+ * Writing resumes after the block with the highest sequence number found in the
+ * partition, at the next sector if the rest of its sector is not erased.
+ *
+ * @return the sink, or NULL if the configuration is invalid or the buffers could not be allocated
+ */
+ulog_flash_sink_t *ulog_flash_sink_create(const ulog_flash_sink_config_t *config);
+
+/**
+ * @brief Free a flash sink
+ *
+ * Remove the sink with ulog_sink_remove() and call ulog_flash_sink_flush() first.
+ */
+void ulog_flash_sink_destroy(ulog_flash_sink_t *sink);
+
+/**
+ * @brief Write the entries buffered in RAM to the partition
+ *
+ * Accesses the flash from the calling thread, e.g. before a reset.
+ */
+void ulog_flash_sink_flush(ulog_flash_sink_t *sink);
+
+/**
+ * @brief Write function of a flash sink, see ulog_sink_write_t
+ */
+void ulog_flash_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/**
+ * @brief Poll function of a flash sink, see ulog_sink_poll_t
+ */
+void ulog_flash_sink_poll(void *ctx);
+
+/**
+ * @brief Read the blocks stored by a flash sink, oldest first
+ *
+ * Blocks are decompressed in a buffer allocated for the call. Reading a sector stops
+ * at the first block that cannot be read or whose CRC does not match. Entries still
+ * in RAM are not read, see ulog_flash_sink_flush().
+ *
+ * @param fn  function called with the header and the entries of every block, returns false to stop
+ * @param arg argument passed to fn
+ *
+ * @return false if the buffer could not be allocated
+ */
+bool ulog_flash_sink_foreach(ulog_flash_sink_t *sink,
+                             bool (*fn)(const ulog_flash_header_t *header, const char *text, size_t len, void *arg),
+                             void *arg);
+
+/**
+ * @brief Call cb for the entries stored by a flash sink matching all the given criteria, oldest first
+ *
+ * Only the blocks whose header may match are read and decompressed, see
+ * ulog_flash_header_t. The seq field of the entries is the sequence number of their
+ * block. Same criteria as ulog_query(), entries without a timestamp in milliseconds
+ * match any time range, entries without a prefix (level ULOG_NONE in the record)
+ * match any level and time range, but no tag.
+ *
+ * @param from_ts first time, in milliseconds (ulog_timestamp())
+ * @param to_ts   last time, UINT32_MAX for the latest entries
+ * @param level   most verbose level, e.g. ULOG_WARN for the errors and warnings
+ * @param tag     tag of the entries, NULL for any tag
+ * @param cb      function called for every entry
+ * @param arg     argument passed to cb
+ *
+ * @return number of entries passed to cb
+ */
+size_t ulog_flash_sink_query(ulog_flash_sink_t *sink, uint32_t from_ts, uint32_t to_ts, ulog_level_t level,
+                             const char *tag, ulog_backtrace_cb_t cb, void *arg);
+
+/**
+ * @brief Number of bytes of entries a flash sink dropped because both of its blocks were full
+ */
+size_t ulog_flash_sink_dropped(const ulog_flash_sink_t *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_FLASH_H__ */
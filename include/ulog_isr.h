@@ -0,0 +1,65 @@
+#ifndef __ULOG_ISR_H__
+#define __ULOG_ISR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Write a log entry from an interrupt handler
+ *
+ * The entry is encoded as a binary record (see ulog_set_binary_output()) into a
+ * lock-free ring shared by all the interrupt handlers, it never blocks nor enters
+ * a critical section. The drain task of the asynchronous output formats the record
+ * later and writes it to the sinks. Without a running drain task, records are
+ * written by ulog_async_flush().
+ *
+ * Entries are timestamped with ulog_timestamp(), and may be written after entries
+ * logged later by tasks. They are dropped when the ring is full, see ulog_isr_dropped().
+ *
+ * The format should be a string literal, prefer the ULOGx_ISR macros.
+ */
+void ulog_write_isr(ulog_level_t level, const char *tag, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
+
+/**
+ * @brief Number of entries lost because the ring of the interrupt handlers was full
+ */
+uint32_t ulog_isr_dropped(void);
+
+/**
+ * @brief Macro to output a log entry from an interrupt handler at a specified level
+ *
+ * @see ulog_write_isr()
+ */
+#if defined(__cplusplus) && (__cplusplus >  201703L)
+#define ULOG_ISR(level, tag, format, ...) do {                                                     \
+        if (LOG_LOCAL_LEVEL >= (level) && (level) <= __atomic_load_n(&ulog_max_level, __ATOMIC_RELAXED)) { \
+            static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;           \
+            ulog_write_isr(level, tag, _ulog_fmt __VA_OPT__(,) __VA_ARGS__);                       \
+        }} while(0)
+#define ULOGE_ISR( tag, format, ... ) ULOG_ISR(ULOG_ERROR,   tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ULOGW_ISR( tag, format, ... ) ULOG_ISR(ULOG_WARN,    tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ULOGI_ISR( tag, format, ... ) ULOG_ISR(ULOG_INFO,    tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ULOGD_ISR( tag, format, ... ) ULOG_ISR(ULOG_DEBUG,   tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ULOGV_ISR( tag, format, ... ) ULOG_ISR(ULOG_VERBOSE, tag, format __VA_OPT__(,) __VA_ARGS__)
+#else // !(defined(__cplusplus) && (__cplusplus >  201703L))
+#define ULOG_ISR(level, tag, format, ...) do {                                                     \
+        if (LOG_LOCAL_LEVEL >= (level) && (level) <= __atomic_load_n(&ulog_max_level, __ATOMIC_RELAXED)) { \
+            static const char _ulog_fmt[] __attribute__((section("ulog_fmt"))) = format;           \
+            ulog_write_isr(level, tag, _ulog_fmt, ##__VA_ARGS__);                                  \
+        }} while(0)
+#define ULOGE_ISR( tag, format, ... ) ULOG_ISR(ULOG_ERROR,   tag, format, ##__VA_ARGS__)
+#define ULOGW_ISR( tag, format, ... ) ULOG_ISR(ULOG_WARN,    tag, format, ##__VA_ARGS__)
+#define ULOGI_ISR( tag, format, ... ) ULOG_ISR(ULOG_INFO,    tag, format, ##__VA_ARGS__)
+#define ULOGD_ISR( tag, format, ... ) ULOG_ISR(ULOG_DEBUG,   tag, format, ##__VA_ARGS__)
+#define ULOGV_ISR( tag, format, ... ) ULOG_ISR(ULOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_ISR_H__ */
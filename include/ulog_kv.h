@@ -0,0 +1,176 @@
+#ifndef __ULOG_KV_H__
+#define __ULOG_KV_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Type of the value of a field of a structured entry
+ */
+typedef enum {
+    ULOG_KV_UINT,       /*!< Unsigned integer, CBOR major type 0 */
+    ULOG_KV_INT,        /*!< Signed integer, CBOR major type 0 or 1 */
+    ULOG_KV_DOUBLE,     /*!< Double precision float, CBOR major type 7 */
+    ULOG_KV_BOOL,       /*!< CBOR true or false */
+    ULOG_KV_STR,        /*!< NUL terminated string, CBOR major type 3 */
+    ULOG_KV_BYTES,      /*!< Byte string, CBOR major type 2 */
+} ulog_kv_type_t;
+
+/**
+ * @brief Field of a structured entry, see ULOG_KV()
+ *
+ * Strings and byte strings are referenced, not copied, they are read before
+ * ulog_write_kv() returns.
+ */
+typedef struct {
+    const char *key;                /*!< Name of the field */
+    ulog_kv_type_t type;            /*!< Type of the value */
+    union {
+        uint64_t u;
+        int64_t i;
+        double d;
+        bool b;
+        const char *str;
+        const void *bytes;
+    } value;
+    size_t len;                     /*!< Length of a byte string */
+} ulog_kv_t;
+
+/** @cond */
+static inline ulog_kv_t ulog_kv_uint(const char *key, uint64_t value)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_UINT;
+    kv.value.u = value;
+    kv.len = 0;
+    return kv;
+}
+
+static inline ulog_kv_t ulog_kv_int(const char *key, int64_t value)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_INT;
+    kv.value.i = value;
+    kv.len = 0;
+    return kv;
+}
+
+static inline ulog_kv_t ulog_kv_double(const char *key, double value)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_DOUBLE;
+    kv.value.d = value;
+    kv.len = 0;
+    return kv;
+}
+
+static inline ulog_kv_t ulog_kv_bool(const char *key, bool value)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_BOOL;
+    kv.value.b = value;
+    kv.len = 0;
+    return kv;
+}
+
+static inline ulog_kv_t ulog_kv_str(const char *key, const char *value)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_STR;
+    kv.value.str = value ? value : "(null)";
+    kv.len = 0;
+    return kv;
+}
+
+static inline ulog_kv_t ulog_kv_bytes(const char *key, const void *value, size_t len)
+{
+    ulog_kv_t kv;
+    kv.key = key;
+    kv.type = ULOG_KV_BYTES;
+    kv.value.bytes = value;
+    kv.len = len;
+    return kv;
+}
+/** @endcond */
+
+/** @brief Unsigned 32-bit field of ULOG_KV() */
+#define ULOG_U32(key, value)            ulog_kv_uint(key, (uint32_t) (value))
+/** @brief Unsigned 64-bit field of ULOG_KV() */
+#define ULOG_U64(key, value)            ulog_kv_uint(key, (uint64_t) (value))
+/** @brief Signed 32-bit field of ULOG_KV() */
+#define ULOG_I32(key, value)            ulog_kv_int(key, (int32_t) (value))
+/** @brief Signed 64-bit field of ULOG_KV() */
+#define ULOG_I64(key, value)            ulog_kv_int(key, (int64_t) (value))
+/** @brief Floating point field of ULOG_KV() */
+#define ULOG_F64(key, value)            ulog_kv_double(key, (double) (value))
+/** @brief Boolean field of ULOG_KV() */
+#define ULOG_BOOL(key, value)           ulog_kv_bool(key, (value) != 0)
+/** @brief String field of ULOG_KV(), NULL is logged as "(null)" */
+#define ULOG_STR(key, value)            ulog_kv_str(key, value)
+/** @brief Byte string field of ULOG_KV() */
+#define ULOG_BYTES(key, value, len)     ulog_kv_bytes(key, value, len)
+
+/**
+ * @brief Write a structured entry into the log
+ *
+ * The entry goes through the same level checks as ulog_write(). Sinks added with
+ * ``structured`` set receive it as one CBOR (RFC 8949) record, an array of:
+ *
+ *      uint    timestamp in milliseconds, see ulog_timestamp()
+ *      uint    level
+ *      text    tag
+ *      text    message
+ *      map     of indefinite length, the key of every field to its value
+ *
+ * Fields which do not fit in CONFIG_LOG_KV_RECORD_MAX bytes are left out, entries
+ * queued by the asynchronous output reach the sink as a CBOR sequence (RFC 8742).
+ * The other sinks and the backtrace store receive the entry as a text line with the
+ * usual prefix, the message followed by key=value pairs: ``I (123) tag: msg len=5 peer="abc"``.
+ *
+ * @param level level of the entry
+ * @param tag tag of the entry
+ * @param msg message of the entry, not a format
+ * @param fields fields of the entry
+ * @param count number of fields
+ */
+void ulog_write_kv(ulog_level_t level, const char *tag, const char *msg, const ulog_kv_t *fields, size_t count);
+
+/** @cond */
+void ulog_write_kv_unchecked(ulog_level_t level, const char *tag, const char *msg, const ulog_kv_t *fields, size_t count);
+/** @endcond */
+
+/**
+ * @brief Macro to write a structured entry at a specified level
+ *
+ * Usage: ``ULOG_KV(ULOG_INFO, TAG, "rx", ULOG_U32("len", n), ULOG_STR("peer", p))``
+ *
+ * The fields are only evaluated when the entry is enabled, and checked against
+ * ``LOG_LOCAL_LEVEL`` and the rate limit of the call site like the ULOGx macros.
+ *
+ * @see ``ulog_write_kv``
+ */
+#define ULOG_KV(level, tag, msg, ...) \
+        ULOG_LOCAL_CHECKED(level, tag, msg, ULOG_KV_UNCHECKED(level, tag, msg, __VA_ARGS__))
+
+/** @cond */
+#define ULOG_KV_UNCHECKED(level, tag, msg, ...) do {                                               \
+        const ulog_kv_t _ulog_kv[] = { __VA_ARGS__ };                                              \
+        ulog_write_kv_unchecked(level, tag, msg, _ulog_kv, sizeof(_ulog_kv) / sizeof(_ulog_kv[0])); \
+    } while(0)
+/** @endcond */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_KV_H__ */
@@ -0,0 +1,174 @@
+#ifndef __ULOG_LINUX_H__
+#define __ULOG_LINUX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Alignment of the writes of a file descriptor sink opened with O_DIRECT
+ */
+#define ULOG_FD_SINK_ALIGN 4096
+
+/**
+ * @brief Configuration of a file descriptor sink
+ */
+typedef struct {
+    int fd;                     /*!< File descriptor the entries are written to, not closed by the sink */
+    size_t buffer_size;         /*!< Bytes buffered before they are written, rounded up to ULOG_FD_SINK_ALIGN */
+    uint32_t flush_period_ms;   /*!< Maximum time an entry stays in the buffer, 0 to write every entry right away */
+    ulog_level_t flush_level;   /*!< Entries at this and more severe levels are written right away */
+    bool direct;                /*!< fd was opened with O_DIRECT, it must be a regular file */
+    bool datasync;              /*!< Call fdatasync() after every write */
+} ulog_fd_sink_config_t;
+
+/**
+ * @brief Default configuration of a file descriptor sink
+ */
+#define ULOG_FD_SINK_CONFIG_DEFAULT(file_descriptor) {              \
+        .fd = (file_descriptor),                                    \
+        .buffer_size = CONFIG_LOG_FD_SINK_BUFFER_SIZE,              \
+        .flush_period_ms = CONFIG_LOG_FD_SINK_FLUSH_PERIOD_MS,      \
+        .flush_level = ULOG_ERROR,                                  \
+        .direct = false,                                            \
+        .datasync = false,                                          \
+    }
+
+typedef struct ulog_fd_sink ulog_fd_sink_t;
+
+/**
+ * @brief Create a sink writing to a file descriptor
+ *
+ * Entries are copied into a buffer aligned for O_DIRECT, which is written with a
+ * single system call once it is full, once its oldest entry is older than the flush
+ * period, or when an entry at the flush level is logged. Entries that do not fit
+ * are written along with the buffer by writev(), without being copied.
+ *
+ * The sink is registered with ulog_sink_add(), e.g.:
+ *
+ *      ulog_fd_sink_t *file = ulog_fd_sink_create(&config);
+ *      ulog_sink_config_t sink = {
+ *          .write = &ulog_fd_sink_write,
+ *          .poll = &ulog_fd_sink_poll,
+ *          .ctx = file,
+ *          .level = ULOG_INFO,
+ *      };
+ *      ulog_sink_add(&sink);
+ *
+ * The flush period is enforced by the drain task of the asynchronous output, without
+ * it the buffer is only written by the next entry or by ulog_fd_sink_flush().
+ *
+ * @return the sink, or NULL if the buffer could not be allocated
+ */
+ulog_fd_sink_t *ulog_fd_sink_create(const ulog_fd_sink_config_t *config);
+
+/**
+ * @brief Write out the entries buffered by a file descriptor sink
+ *
+ * With O_DIRECT, the last partial block is written padded with zeros, and written
+ * again by the next flush once more entries are appended to it.
+ */
+void ulog_fd_sink_flush(ulog_fd_sink_t *sink);
+
+/**
+ * @brief Flush and free a file descriptor sink
+ *
+ * Remove the sink with ulog_sink_remove() first. With O_DIRECT, the file is truncated
+ * to the length of the entries written.
+ */
+void ulog_fd_sink_destroy(ulog_fd_sink_t *sink);
+
+/**
+ * @brief Write function of a file descriptor sink, see ulog_sink_write_t
+ */
+void ulog_fd_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/**
+ * @brief Poll function of a file descriptor sink, see ulog_sink_poll_t
+ */
+void ulog_fd_sink_poll(void *ctx);
+
+/**
+ * @brief Header at the start of every segment file of a memory-mapped sink
+ *
+ * Readers map the file and follow end, entries are complete up to it. Fields are
+ * in the byte order of the writer.
+ */
+typedef struct {
+    uint32_t magic;             /*!< ULOG_MMAP_MAGIC */
+    uint32_t header_size;       /*!< Offset of the first entry */
+    uint64_t seq;               /*!< Sequence number of the segment, increases by one with every rotation */
+    uint64_t end;               /*!< Offset past the last entry, stored with release semantics */
+    uint32_t sealed;            /*!< Set once the writer moved to the next segment, end does not change anymore */
+    uint32_t reserved;
+} ulog_mmap_header_t;
+
+#define ULOG_MMAP_MAGIC 0x474f4c55  // "ULOG" in little endian
+
+/**
+ * @brief Configuration of a memory-mapped sink
+ */
+typedef struct {
+    const char *path;           /*!< Segments are named path.0 to path.<segment_count - 1>, the path is copied */
+    size_t segment_size;        /*!< Size of a segment file, header included, rounded up to the page size */
+    unsigned segment_count;     /*!< Number of segment files, the oldest one is reused when the last one fills */
+} ulog_mmap_sink_config_t;
+
+/**
+ * @brief Default configuration of a memory-mapped sink
+ */
+#define ULOG_MMAP_SINK_CONFIG_DEFAULT(file_path) {                  \
+        .path = (file_path),                                        \
+        .segment_size = CONFIG_LOG_MMAP_SINK_SEGMENT_SIZE,          \
+        .segment_count = CONFIG_LOG_MMAP_SINK_SEGMENT_COUNT,        \
+    }
+
+typedef struct ulog_mmap_sink ulog_mmap_sink_t;
+
+/**
+ * @brief Create a sink appending to memory-mapped files
+ *
+ * An entry is copied into the mapping of the current segment file, at an offset
+ * reserved with an atomic increment, then published by moving the end offset in the
+ * header of the segment. No system call is made while logging.
+ *
+ * When the current segment is full, the sink moves to the next one, which the poll
+ * function allocates and maps ahead of time from the drain task of the asynchronous
+ * output. Without it, the next segment is prepared by the entry which fills the
+ * current one. Writing resumes after the segment with the highest sequence number
+ * found in the existing files.
+ *
+ * Register it like a file descriptor sink, with ulog_mmap_sink_write() and
+ * ulog_mmap_sink_poll(). Entries larger than a segment are dropped.
+ *
+ * @return the sink, or NULL if the first segment could not be created
+ */
+ulog_mmap_sink_t *ulog_mmap_sink_create(const ulog_mmap_sink_config_t *config);
+
+/**
+ * @brief Unmap the segments of a memory-mapped sink and free it
+ *
+ * Remove the sink with ulog_sink_remove() first. The current segment file is
+ * truncated to its end offset.
+ */
+void ulog_mmap_sink_destroy(ulog_mmap_sink_t *sink);
+
+/**
+ * @brief Write function of a memory-mapped sink, see ulog_sink_write_t
+ */
+void ulog_mmap_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/**
+ * @brief Poll function of a memory-mapped sink, see ulog_sink_poll_t
+ */
+void ulog_mmap_sink_poll(void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_LINUX_H__ */
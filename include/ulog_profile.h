@@ -0,0 +1,59 @@
+#ifndef __ULOG_PROFILE_H__
+#define __ULOG_PROFILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counters of a tag, since startup or ulog_profile_reset()
+ *
+ * Counts of entries and bytes wrap around, like those of ulog_get_stats(). Cycles
+ * are counted with the cycle counter of the CPU running the entry, in 64 bits so
+ * that the tags are still ranked after hours of formatting.
+ */
+typedef struct {
+    const char *tag;            /*!< Tag name */
+    uint32_t count;             /*!< Entries passed to a sink or to the backtrace store */
+    uint32_t filtered;          /*!< Entries rejected by the level of the tag, by every sink or by the keyword filters */
+    size_t bytes;               /*!< Bytes of the formatted entries */
+    uint64_t format_cycles;     /*!< Cycles spent formatting the entries */
+    uint64_t sink_cycles;       /*!< Cycles spent passing the entries to the sinks, or to the asynchronous output */
+} ulog_profile_t;
+
+/**
+ * @brief Read the counters of the tags which cost the most cycles
+ *
+ * With CONFIG_LOG_PROFILE, every entry reaching ulog_writev() is counted in the slot
+ * of its tag, found by its pointer in a table of CONFIG_LOG_PROFILE_TAGS slots filled
+ * without any lock. Entries rejected by ulog_enabled() in the ULOGx macros are not
+ * counted as filtered, see ulog_get_stats(). Tags found once the table is full are
+ * not counted.
+ *
+ * @param tags  array receiving the counters, by decreasing format_cycles + sink_cycles
+ * @param count number of elements of tags
+ *
+ * @return number of tags written to tags, 0 without CONFIG_LOG_PROFILE
+ */
+size_t ulog_profile_get(ulog_profile_t *tags, size_t count);
+
+/**
+ * @brief Write the counters of the tags which cost the most cycles with the output function
+ *
+ * @param count maximum number of tags
+ */
+void ulog_profile_dump(size_t count);
+
+/**
+ * @brief Reset the counters of every tag to zero
+ */
+void ulog_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_PROFILE_H__ */
@@ -0,0 +1,49 @@
+#ifndef __ULOG_RATELIMIT_H__
+#define __ULOG_RATELIMIT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ulog_site.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_LOG_RATE_LIMIT
+/** @cond */
+/* Slow path of ulog_site_take(), once the bucket is empty */
+bool ulog_site_refill(ulog_site_t *site, ulog_level_t level, const char *tag);
+/** @endcond */
+
+/**
+ * @brief Take a token from the bucket of a call site
+ *
+ * @return false if the entry should be dropped
+ */
+static inline bool ulog_site_take(ulog_site_t *site, ulog_level_t level, const char *tag)
+{
+    if (__atomic_sub_fetch(&site->tokens, 1, __ATOMIC_RELAXED) >= 0) {
+        return true;
+    }
+    return ulog_site_refill(site, level, tag);
+}
+#endif
+
+/**
+ * @brief Number of entries dropped by the rate limit of their call site since startup
+ */
+uint32_t ulog_suppressed(void);
+
+/**
+ * @brief Write the number of entries suppressed by every call site since its last entry
+ *
+ * Otherwise written before the next entry of the call site, once its bucket is
+ * refilled. Also done by ulog_async_flush() and at process exit.
+ */
+void ulog_suppressed_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_RATELIMIT_H__ */
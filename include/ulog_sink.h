@@ -0,0 +1,85 @@
+#ifndef __ULOG_SINK_H__
+#define __ULOG_SINK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Function called with every formatted log entry accepted by a sink
+ *
+ * The entry is formatted once and the same buffer is passed to every sink. With the
+ * asynchronous output, several consecutive entries may be passed in one call, level
+ * is then the most severe level among them.
+ *
+ * A structured sink receives CBOR records instead of text, buf is then not NUL
+ * terminated and may contain any byte.
+ *
+ * @note Like the vprintf function, this can be invoked in parallel from multiple thread
+ * context when the asynchronous output is not running.
+ */
+typedef void (*ulog_sink_write_t)(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/**
+ * @brief Function called periodically by the drain task of the asynchronous output
+ *
+ * Lets a sink which buffers entries write them out after a delay, or prepare its
+ * storage ahead of time, outside of the logging path. Entries too large for the
+ * ring buffers are still written by the logging thread, so this may run at the same
+ * time as the write function of the sink.
+ */
+typedef void (*ulog_sink_poll_t)(void *ctx);
+
+/**
+ * @brief Configuration of a sink
+ */
+typedef struct {
+    ulog_sink_write_t write;    /*!< Function receiving the entries */
+    ulog_sink_poll_t poll;      /*!< Function called periodically by the drain task, may be NULL */
+    void *ctx;                  /*!< Argument passed to write */
+    ulog_level_t level;         /*!< Only entries at this and lower verbosity levels are passed */
+    const char *tag_filter;     /*!< NULL for all tags, a tag, or a tag prefix followed by '*', e.g. "wifi*" */
+    bool structured;            /*!< Receive only the ULOG_KV() entries, as CBOR records, see ulog_write_kv() */
+} ulog_sink_config_t;
+
+/**
+ * @brief Id of the console sink, which writes with the function set by ulog_set_vprintf()
+ */
+#define ULOG_SINK_CONSOLE 0
+
+/**
+ * @brief Add a sink
+ *
+ * @param config configuration of the sink, the tag filter is copied
+ *
+ * @return id of the sink, or -1 if CONFIG_LOG_SINK_MAX sinks are already registered
+ */
+int ulog_sink_add(const ulog_sink_config_t *config);
+
+/**
+ * @brief Remove a sink
+ *
+ * The write function may still be running in another thread when this returns.
+ * With the asynchronous output, call ulog_async_flush() before releasing ctx.
+ *
+ * @param id id returned by ulog_sink_add(), or ULOG_SINK_CONSOLE
+ */
+void ulog_sink_remove(int id);
+
+/**
+ * @brief Set the maximum level of the entries passed to a sink
+ *
+ * @param id id returned by ulog_sink_add(), or ULOG_SINK_CONSOLE
+ * @param level only entries at this and lower verbosity levels are passed
+ */
+void ulog_sink_level_set(int id, ulog_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_SINK_H__ */
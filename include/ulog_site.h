@@ -0,0 +1,134 @@
+#ifndef __ULOG_SITE_H__
+#define __ULOG_SITE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Mode of a call site of the ULOGx macros, see ulog_sites_set()
+ */
+typedef enum {
+    ULOG_SITE_DEFAULT,  /*!< Entries are written according to the level of their tag */
+    ULOG_SITE_ON,       /*!< Entries are written whatever the level of their tag */
+    ULOG_SITE_OFF,      /*!< Entries are never written */
+} ulog_site_mode_t;
+
+/**
+ * @brief Call site of the ULOGx macros
+ *
+ * Every expansion of the ULOGx, ULOG_LEVEL_LOCAL and ULOG_KV macros defines one.
+ * With CONFIG_LOG_SITES, it describes the call site and is placed in the
+ * ulog_sites linker section, which ulog_sites_set() walks. Its mode is the first
+ * byte of the descriptor, and the size of the descriptor is its alignment, so that
+ * the check of a site and its rate limit never span two cache lines. That is 64 bytes
+ * of RAM per call site on 64-bit targets, 32 bytes on 32-bit ones.
+ *
+ * With CONFIG_LOG_RATE_LIMIT, it holds the token bucket of the call site: every
+ * entry takes a token, the bucket holds up to CONFIG_LOG_RATE_LIMIT_BURST tokens
+ * and is refilled with CONFIG_LOG_RATE_LIMIT_PER_SEC tokens per second. Entries of
+ * an empty bucket are dropped before being formatted, and counted: the next entry
+ * written by the call site is preceded by the number of entries it lost. While
+ * ulog_timestamp() returns 0, e.g. without a clock, entries are not limited.
+ */
+typedef struct {
+#if CONFIG_LOG_SITES
+    uint8_t mode;           /*!< ulog_site_mode_t as uint8_t */
+    uint8_t level;          /*!< Level of the entries (ulog_level_t), ULOG_NONE if not known at compile time */
+    uint8_t local_level;    /*!< LOG_LOCAL_LEVEL of the file, the site is compiled out below level */
+    uint8_t reserved;
+    uint32_t line;          /*!< Line of the call site */
+    const char *file;       /*!< Source file of the call site, as given by __FILE__ */
+    const char *format;     /*!< Format of the entries, or message of ULOG_KV(), NULL if not known at compile time */
+#endif
+#if CONFIG_LOG_RATE_LIMIT
+    int32_t tokens;         /*!< Tokens left, negative once the bucket is empty */
+    uint32_t refill_ts;     /*!< Time of the last refill, in milliseconds (ulog_timestamp()), 0 at startup */
+    uint32_t suppressed;    /*!< Entries dropped since the last one written */
+#endif
+#if CONFIG_LOG_SITES
+} __attribute__((aligned(sizeof(void *) == 8 ? 64 : 32))) ulog_site_t;
+#else
+} ulog_site_t;
+#endif
+
+/** @cond */
+#if CONFIG_LOG_SITES
+// bounds of the section, see __start_ulog_tags
+extern ulog_site_t __start_ulog_sites[] __attribute__((weak));
+extern ulog_site_t __stop_ulog_sites[] __attribute__((weak));
+
+// level and format are not always constants, e.g. with ULOG_LEVEL_LOCAL()
+#define _ULOG_SITE_CONST(value, fallback)       (__builtin_constant_p(value) ? (value) : (fallback))
+#define _ULOG_SITE_DESC_INIT(level, format) \
+        ULOG_SITE_DEFAULT, _ULOG_SITE_CONST(level, ULOG_NONE), LOG_LOCAL_LEVEL, 0, __LINE__, __FILE__, \
+        _ULOG_SITE_CONST(format, NULL),
+#define _ULOG_SITE_SECTION                      __attribute__((section("ulog_sites")))
+#else
+#define _ULOG_SITE_DESC_INIT(level, format)
+#define _ULOG_SITE_SECTION
+#endif
+#if CONFIG_LOG_RATE_LIMIT
+#define _ULOG_SITE_RATE_INIT                    CONFIG_LOG_RATE_LIMIT_BURST, 0, 0
+#else
+#define _ULOG_SITE_RATE_INIT
+#endif
+#define ULOG_SITE_INIT(level, format)           { _ULOG_SITE_DESC_INIT(level, format) _ULOG_SITE_RATE_INIT }
+/** @endcond */
+
+/**
+ * @brief Whether the entries of a call site are enabled
+ *
+ * A call site in the ULOG_SITE_DEFAULT mode checks the level of the tag with
+ * ulog_enabled(), the other modes take a single branch on the mode byte.
+ */
+static inline bool ulog_site_enabled(ulog_site_t *site, ulog_level_t level, const char *tag)
+{
+#if CONFIG_LOG_SITES
+    uint8_t mode = __atomic_load_n(&site->mode, __ATOMIC_RELAXED);
+    if (__builtin_expect(mode != ULOG_SITE_DEFAULT, 0)) {
+        return mode == ULOG_SITE_ON;
+    }
+#else
+    (void) site;
+#endif
+    return ulog_enabled(tag, level);
+}
+
+/**
+ * @brief Set the mode of the call sites matching all the given criteria
+ *
+ * Only the call sites compiled in are considered, not those above LOG_LOCAL_LEVEL,
+ * which GCC keeps in the section without optimizations. A site turned on is still
+ * subject to its rate limit and to the levels of the sinks.
+ *
+ * Usage: ``ulog_sites_set("wifi.c", 120, 180, NULL, ULOG_SITE_ON)``
+ *
+ * @param file        end of the path of the source file, from a '/', e.g. "wifi.c" or "net/wifi.c", NULL for any file
+ * @param first_line  first line of the range, 0 for the start of the file
+ * @param last_line   last line of the range, 0 for the end of the file
+ * @param format      string found in the format of the entries, NULL for any format
+ * @param mode        new mode of the call sites
+ *
+ * @return number of call sites matching, 0 without CONFIG_LOG_SITES
+ */
+size_t ulog_sites_set(const char *file, uint32_t first_line, uint32_t last_line, const char *format,
+                      ulog_site_mode_t mode);
+
+/**
+ * @brief Call a function for every call site compiled in, e.g. to list them from a shell
+ *
+ * @param fn  function called with every call site, returns false to stop
+ * @param arg argument passed to fn
+ */
+void ulog_sites_foreach(bool (*fn)(const ulog_site_t *site, void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_SITE_H__ */
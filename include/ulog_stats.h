@@ -0,0 +1,54 @@
+#ifndef __ULOG_STATS_H__
+#define __ULOG_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counters of the logging library, since startup or ulog_reset_stats()
+ *
+ * Counters wrap around, compare two snapshots to get rates.
+ */
+typedef struct {
+    uint32_t emitted[ULOG_VERBOSE + 1];     /*!< Entries passed to a sink or to the backtrace store, by level */
+    uint32_t filtered[ULOG_VERBOSE + 1];    /*!< Entries rejected by ulog_write() or by every sink, by level */
+    uint32_t suppressed;                    /*!< Entries dropped by the rate limit of their call site */
+    uint32_t cache_hits;                    /*!< Levels of string tags found in the tag cache by ulog_write() */
+    uint32_t cache_misses;                  /*!< Levels of string tags searched in the tag table */
+    uint32_t lock_timeouts;                 /*!< Entries whose tag was searched without the lock, see ulog_impl_lock_timeout() */
+    uint32_t async_dropped;                 /*!< Entries dropped because their ring buffer was full */
+    uint32_t isr_dropped;                   /*!< Entries of interrupt handlers dropped because their ring was full */
+    size_t sink_bytes[CONFIG_LOG_SINK_MAX]; /*!< Bytes passed to the write function of every sink, by sink id */
+    uint32_t sink_max_latency_us[CONFIG_LOG_SINK_MAX]; /*!< Longest call to the write function of every sink */
+} ulog_stats_t;
+
+/**
+ * @brief Read the counters of the logging library
+ *
+ * Entries rejected by ulog_enabled() in the ULOGx macros are not counted as filtered,
+ * and the tag cache hits of ulog_level_get() are not counted, so that a disabled
+ * entry costs nothing more than the level check.
+ *
+ * Counters are updated with relaxed atomic operations, spread over
+ * CONFIG_LOG_STATS_SHARDS copies to limit contention between CPUs. The snapshot is
+ * not taken atomically.
+ */
+void ulog_get_stats(ulog_stats_t *stats);
+
+/**
+ * @brief Reset the counters returned by ulog_get_stats() to zero
+ *
+ * ulog_async_dropped(), ulog_isr_dropped() and ulog_suppressed() keep counting
+ * since startup.
+ */
+void ulog_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_STATS_H__ */
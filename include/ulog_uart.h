@@ -0,0 +1,96 @@
+#ifndef __ULOG_UART_H__
+#define __ULOG_UART_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Function starting a DMA transfer of a UART sink
+ *
+ * Starts sending len bytes of buf and returns without waiting. The driver calls
+ * ulog_uart_sink_tx_done() from its TX-complete interrupt once they are sent, buf
+ * stays untouched until then. Called by the logging path, or from
+ * ulog_uart_sink_tx_done() in the interrupt.
+ */
+typedef void (*ulog_uart_start_tx_t)(void *ctx, const void *buf, size_t len);
+
+/**
+ * @brief Configuration of a UART sink
+ */
+typedef struct {
+    ulog_uart_start_tx_t start_tx;  /*!< Function starting a transfer */
+    void *ctx;                      /*!< Argument passed to start_tx */
+    void *buffers[2];               /*!< Two buffers of buffer_size bytes, in memory the DMA can read */
+    size_t buffer_size;             /*!< Size of every buffer */
+    bool block;                     /*!< Wait for a buffer to be sent when both are full, drop the bytes otherwise */
+} ulog_uart_sink_config_t;
+
+typedef struct ulog_uart_sink ulog_uart_sink_t;
+
+/**
+ * @brief Create a sink writing to a DMA-capable UART
+ *
+ * Entries are copied into one buffer while the DMA sends the other one. The
+ * TX-complete interrupt swaps them and starts sending the entries copied in the
+ * meantime, so that writing an entry costs a copy and does not depend on the baud
+ * rate. The buffers are given by the caller, as the DMA of some chips can only
+ * read part of the memory.
+ *
+ * The sink is registered with ulog_sink_add(), e.g. in place of the console:
+ *
+ *      ulog_uart_sink_t *uart = ulog_uart_sink_create(&config);
+ *      ulog_sink_config_t sink = {
+ *          .write = &ulog_uart_sink_write,
+ *          .ctx = uart,
+ *          .level = ULOG_INFO,
+ *      };
+ *      ulog_sink_remove(ULOG_SINK_CONSOLE);
+ *      ulog_sink_add(&sink);
+ *
+ * When both buffers are full, the write waits with ulog_impl_yield() if block is
+ * set, so the TX-complete interrupt must be able to run meanwhile, and drops the
+ * bytes that do not fit otherwise.
+ *
+ * @return the sink, or NULL if it could not be allocated
+ */
+ulog_uart_sink_t *ulog_uart_sink_create(const ulog_uart_sink_config_t *config);
+
+/**
+ * @brief Free a UART sink
+ *
+ * Remove the sink with ulog_sink_remove() and call ulog_uart_sink_flush() first.
+ */
+void ulog_uart_sink_destroy(ulog_uart_sink_t *sink);
+
+/**
+ * @brief Wait until the entries written to a UART sink are sent
+ */
+void ulog_uart_sink_flush(ulog_uart_sink_t *sink);
+
+/**
+ * @brief Write function of a UART sink, see ulog_sink_write_t
+ */
+void ulog_uart_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/**
+ * @brief Signal the end of a transfer of a UART sink, from the TX-complete interrupt
+ *
+ * Starts sending the other buffer if entries were copied into it.
+ */
+void ulog_uart_sink_tx_done(ulog_uart_sink_t *sink);
+
+/**
+ * @brief Number of bytes a UART sink dropped because both of its buffers were full
+ */
+size_t ulog_uart_sink_dropped(const ulog_uart_sink_t *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ULOG_UART_H__ */
@@ -1,7 +1,7 @@
 #include <unistd.h>
 #include "ulog.h"
 
-static const char *TAG = "main";
+ULOG_DEFINE_TAG(TAG, "main");
 
 int main(int argc, char *argv[])
 {
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+#
+# Decode binary ulog records (see ulog_set_binary_output() in include/ulog_binary.h)
+# back to text, using the ELF file of the firmware for formats and tags.
+#
+# usage: ulog_decode.py firmware.elf [records.bin]    (records are read from stdin by default)
+
+import re
+import struct
+import sys
+
+SYNC = 0xa5
+LEVEL_MASK = 0x07
+FMT_INLINE = 0x08
+TAG_INLINE = 0x10
+TRUNCATED = 0x20
+HEADER_SIZE = 8
+TAG_DESC_SIZE = 32
+
+LEVEL_LETTERS = "NEWIDV"
+
+SPEC_RE = re.compile(r"%([-+ #0']*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|q|j|z|t|L)?([diouxXcspnfFeEgGaA%])")
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        self.is64 = data[4] == 2
+        self.endian = "<" if data[5] == 1 else ">"
+        if self.is64:
+            shoff, = struct.unpack_from(self.endian + "Q", data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from(self.endian + "HHH", data, 0x3a)
+        else:
+            shoff, = struct.unpack_from(self.endian + "I", data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from(self.endian + "HHH", data, 0x2e)
+        sections = []
+        for i in range(shnum):
+            off = shoff + i * shentsize
+            if self.is64:
+                name, _, _, _, offset, size = struct.unpack_from(self.endian + "IIQQQQ", data, off)
+            else:
+                name, _, _, _, offset, size = struct.unpack_from(self.endian + "IIIIII", data, off)
+            sections.append((name, offset, size))
+        strtab = sections[shstrndx]
+        self.sections = {}
+        for name, offset, size in sections:
+            end = data.index(b"\0", strtab[1] + name)
+            self.sections[data[strtab[1] + name:end].decode()] = data[offset:offset + size]
+
+    def section(self, name):
+        return self.sections.get(name, b"")
+
+
+def c_string(data, offset):
+    end = data.index(b"\0", offset)
+    return data[offset:end].decode(errors="replace"), end + 1
+
+
+class Decoder:
+    def __init__(self, elf):
+        self.e = elf.endian
+        self.word = 8 if elf.is64 else 4
+        self.formats = elf.section("ulog_fmt")
+        self.tags = elf.section("ulog_tags")
+
+    def tag_name(self, index):
+        return c_string(self.tags, index * TAG_DESC_SIZE + 1)[0]
+
+    def arg(self, record, pos, code):
+        value, = struct.unpack_from(self.e + code, record, pos)
+        return value, pos + struct.calcsize(code)
+
+    def format(self, fmt, record, pos):
+        out = []
+        last = 0
+        for m in SPEC_RE.finditer(fmt):
+            out.append(fmt[last:m.start()])
+            last = m.end()
+            flags, width, precision, length, conv = m.groups()
+            if conv == "%":
+                out.append("%")
+                continue
+            if width == "*":
+                width, pos = self.arg(record, pos, "i")
+            if precision == "*":
+                precision, pos = self.arg(record, pos, "i")
+            if conv in "diouxXc":
+                size = {None: 4, "hh": 4, "h": 4, "l": self.word, "ll": 8, "q": 8, "j": 8,
+                        "z": self.word, "t": self.word, "L": 8}[length]
+                signed = conv in "di"
+                code = {4: "i", 8: "q"}[size]
+                value, pos = self.arg(record, pos, code if signed else code.upper())
+                if conv == "c":
+                    value &= 0xff
+            elif conv in "pn":
+                value, pos = self.arg(record, pos, "Q" if self.word == 8 else "I")
+                if conv == "n":
+                    continue
+            elif conv == "s":
+                value, pos = c_string(record, pos)
+            else:
+                value, pos = self.arg(record, pos, "d")
+            spec = "%" + flags.replace("'", "")
+            if width is not None:
+                spec += str(width)
+            if precision is not None and precision != "" and conv != "s":
+                spec += "." + str(precision)
+            if conv == "p":
+                out.append((spec + "s") % (hex(value) if value else "(nil)"))
+            elif conv == "u":
+                out.append((spec + "d") % value)
+            elif conv in "aA":
+                out.append(float(value).hex())
+            else:
+                out.append((spec + conv) % value)
+        out.append(fmt[last:])
+        return "".join(out), pos
+
+    def decode(self, record):
+        flags = record[1]
+        timestamp, = struct.unpack_from(self.e + "I", record, 4)
+        pos = HEADER_SIZE
+        if flags & FMT_INLINE:
+            fmt, pos = c_string(record, pos)
+        else:
+            offset, pos = self.arg(record, pos, "I")
+            fmt = c_string(self.formats, offset)[0]
+        if flags & TAG_INLINE:
+            tag, pos = c_string(record, pos)
+        else:
+            index, pos = self.arg(record, pos, "H")
+            tag = self.tag_name(index)
+        try:
+            text, _ = self.format(fmt, record, pos)
+        except (struct.error, ValueError):
+            text = fmt
+        if flags & TRUNCATED:
+            text += " [truncated]"
+        letter = LEVEL_LETTERS[flags & LEVEL_MASK]
+        return "%s (%d) %s: %s" % (letter, timestamp, tag, text.rstrip("\r\n"))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("usage: %s firmware.elf [records.bin]" % sys.argv[0])
+    decoder = Decoder(Elf(sys.argv[1]))
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+    pos = 0
+    while pos + HEADER_SIZE <= len(data):
+        if data[pos] != SYNC:
+            pos += 1
+            continue
+        length, = struct.unpack_from(decoder.e + "H", data, pos + 2)
+        if length < HEADER_SIZE or pos + length > len(data):
+            pos += 1
+            continue
+        print(decoder.decode(data[pos:pos + length]))
+        pos += length
+
+
+if __name__ == "__main__":
+    main()
@@ -4,52 +4,103 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdatomic.h>
 #include <assert.h>
 #include "ulog.h"
 #include "ulog_private.h"
 
 #ifndef NDEBUG
-// Enable built-in checks in queue.h in debug builds
-#define INVARIANTS
-// Enable consistency checks and cache statistics in this file.
+// Enable consistency checks in this file.
 #define LOG_BUILTIN_CHECKS
 #endif
 
-#include "sys/queue.h"
+// Number of tags to be cached is 2**TAG_CACHE_BITS.
+#define TAG_CACHE_BITS 5
+#define TAG_CACHE_SIZE (1 << TAG_CACHE_BITS)
 
-// Number of tags to be cached. Must be 2**n - 1, n >= 2.
-#define TAG_CACHE_SIZE 31
+/* The cache is direct-mapped on the tag pointer and read without taking the lock.
+   Every slot is protected by its own sequence counter (odd while the slot is being
+   written), writers are serialized by ulog_impl_lock().
+*/
+typedef struct tag_entry_ tag_entry_t;
 
 typedef struct {
-    const char *tag;
-    uint32_t level : 3;
-    uint32_t generation : 29;
+    atomic_uint seq;
+    _Atomic(const char *) tag;
+    _Atomic(tag_entry_t *) entry;   // NULL if the tag has the default level
 } cached_tag_entry_t;
 
-typedef struct uncached_tag_entry_ {
-    SLIST_ENTRY(uncached_tag_entry_) entries;
-    uint8_t level;  // ulog_level_t as uint8_t
-    char tag[0];    // beginning of a zero-terminated string
-} uncached_tag_entry_t;
+/* Tags given a level with ulog_level_set() are kept in an open-addressing hash
+   table with linear probing. Entries are never removed, so the table can be read
+   without the lock: ulog_level_set("*", level) only marks them unset.
+
+   Entries, with their tag string, are carved out of a static pool. A table slot
+   holds the offset of its entry in the pool in 32-bit words, 0 if the slot is empty.
+*/
+#define TAG_TABLE_SIZE          CONFIG_LOG_TAG_TABLE_SIZE
+#define TAG_TABLE_MAX_ENTRIES   (TAG_TABLE_SIZE * 3 / 4)
+#define TAG_LEVEL_UNSET         0xff
+
+#define TAG_POOL_WORDS          (CONFIG_LOG_TAG_POOL_SIZE / sizeof(uint32_t))
+
+_Static_assert((TAG_TABLE_SIZE & (TAG_TABLE_SIZE - 1)) == 0, "CONFIG_LOG_TAG_TABLE_SIZE must be a power of 2");
+_Static_assert(TAG_POOL_WORDS <= UINT16_MAX, "CONFIG_LOG_TAG_POOL_SIZE is too large for 16-bit slots");
+
+struct tag_entry_ {
+    uint32_t hash;
+    atomic_uint rule;       // level given by the rules, see rule_memo()
+    atomic_uchar level;     // ulog_level_t as uint8_t, or TAG_LEVEL_UNSET
+    char tag[];             // zero-terminated string
+};
+
+/* Prefix rules, e.g. "net.*", are kept in a trie of static nodes, children being
+   a linked list of siblings. Nodes are only added, or all dropped together by
+   ulog_level_set("*", level), and can be read without the lock.
+
+   The level a rule gives to a tag is resolved once and memoized in the entry of
+   the tag, with the generation of the rules it was resolved with: every change of
+   the rules increments the generation.
+*/
+#define RULE_NODES              CONFIG_LOG_LEVEL_RULE_NODES
+
+_Static_assert(RULE_NODES <= UINT16_MAX, "CONFIG_LOG_LEVEL_RULE_NODES is too large for 16-bit links");
+
+typedef struct {
+    char c;                 // last character of the prefix of the node
+    atomic_uchar level;     // level of the rule ending here, or TAG_LEVEL_UNSET
+    atomic_ushort child;    // first child, 0 if none
+    atomic_ushort next;     // next sibling, 0 if none
+} rule_node_t;
+
+// node 0 is the root, the empty prefix
+static rule_node_t s_rule_nodes[RULE_NODES] = {
+    [0] = { .level = TAG_LEVEL_UNSET },
+};
+static uint32_t s_rule_nodes_used = 1;
+static uint32_t s_rule_count;           // rules set, 0 skips the lookups
+static atomic_uint s_rule_generation = 1;
 
 ulog_level_t ulog_default_level = CONFIG_LOG_DEFAULT_LEVEL;
-static SLIST_HEAD(log_tags_head, uncached_tag_entry_) s_log_tags = SLIST_HEAD_INITIALIZER(s_log_tags);
+ulog_level_t ulog_max_level = CONFIG_LOG_DEFAULT_LEVEL;
+static ulog_level_t s_tag_max_level = CONFIG_LOG_DEFAULT_LEVEL;    // most verbose level of a tag
+static atomic_ushort s_tag_table[TAG_TABLE_SIZE];
+static uint32_t s_tag_count;
+static uint32_t s_tag_pool[TAG_POOL_WORDS];
+static uint32_t s_tag_pool_used = 1;    // in words, offset 0 marks an empty slot
+static uint32_t s_tag_level_counts[ULOG_VERBOSE + 1];    // entries set to each level
 static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
-static uint32_t s_log_cache_max_generation = 0;
-static uint32_t s_log_cache_entry_count = 0;
 static vprintf_like_t s_log_print_func = &vprintf;
 
-#ifdef LOG_BUILTIN_CHECKS
-static uint32_t s_log_cache_misses = 0;
-#endif
-
 static inline bool get_cached_log_level(const char *tag, ulog_level_t *level);
-static inline bool get_uncached_log_level(const char *tag, ulog_level_t *level);
-static inline void add_to_cache(const char *tag, ulog_level_t level);
-static void heap_bubble_down(int index);
-static inline void heap_swap(int i, int j);
+static inline tag_entry_t *tag_table_find(const char *tag, uint32_t hash);
+static inline void add_to_cache(const char *tag, tag_entry_t *entry);
+static inline void cache_entry_store(cached_tag_entry_t *slot, const char *tag, tag_entry_t *entry);
 static inline bool should_output(ulog_level_t level_for_message, ulog_level_t level_for_tag);
-static inline void clear_log_level_list(void);
+static void update_max_level(void);
+static void update_tag_max_level(void);
+static void update_tag_descs(const char *tag, ulog_level_t level);
+static void update_rule_descs(const char *prefix, size_t len);
+static inline void ulog_output(ulog_level_t level, const char *tag, const char *format, va_list args);
 
 vprintf_like_t ulog_set_vprintf(vprintf_like_t func)
 {
@@ -60,97 +111,359 @@ vprintf_like_t ulog_set_vprintf(vprintf_like_t func)
     return orig_func;
 }
 
+static inline uint32_t tag_hash(const char *tag)
+{
+    return ulog_tag_hash_n(tag, strlen(tag));
+}
+
+/* Level of the longest rule matching the tag, or TAG_LEVEL_UNSET */
+static uint8_t rule_lookup(const char *tag)
+{
+    const rule_node_t *node = &s_rule_nodes[0];
+    uint8_t level = atomic_load_explicit(&node->level, memory_order_relaxed);
+    for (; *tag; ++tag) {
+        uint16_t i = atomic_load_explicit(&node->child, memory_order_acquire);
+        while (i != 0 && s_rule_nodes[i].c != *tag) {
+            i = atomic_load_explicit(&s_rule_nodes[i].next, memory_order_acquire);
+        }
+        if (i == 0) {
+            break;
+        }
+        node = &s_rule_nodes[i];
+        uint8_t node_level = atomic_load_explicit(&node->level, memory_order_relaxed);
+        if (node_level != TAG_LEVEL_UNSET) {
+            level = node_level;
+        }
+    }
+    return level;
+}
+
+/* Memoized value of rule_lookup() for the entry, resolved again after a change of the rules */
+static __attribute__((noinline)) uint8_t rule_memo(tag_entry_t *entry)
+{
+    uint32_t generation = atomic_load_explicit(&s_rule_generation, memory_order_acquire) & 0xffffff;
+    uint32_t memo = atomic_load_explicit(&entry->rule, memory_order_relaxed);
+    if ((memo >> 8) == generation) {
+        return (uint8_t) memo;
+    }
+    uint8_t level = rule_lookup(entry->tag);
+    atomic_store_explicit(&entry->rule, generation << 8 | level, memory_order_relaxed);
+    return level;
+}
+
+static inline ulog_level_t tag_entry_level(tag_entry_t *entry)
+{
+    uint8_t level = entry ? atomic_load_explicit(&entry->level, memory_order_relaxed) : TAG_LEVEL_UNSET;
+    if (level == TAG_LEVEL_UNSET && entry && __atomic_load_n(&s_rule_count, __ATOMIC_RELAXED) != 0) {
+        level = rule_memo(entry);
+    }
+    if (level == TAG_LEVEL_UNSET) {
+        return (ulog_level_t) __atomic_load_n(&ulog_default_level, __ATOMIC_RELAXED);
+    }
+    return (ulog_level_t) level;
+}
+
+/* Level of a tag which may have no entry, i.e. not cached */
+static inline ulog_level_t tag_level(const char *tag, tag_entry_t *entry)
+{
+    if (entry == NULL && __atomic_load_n(&s_rule_count, __ATOMIC_RELAXED) != 0) {
+        uint8_t level = rule_lookup(tag);
+        if (level != TAG_LEVEL_UNSET) {
+            return (ulog_level_t) level;
+        }
+    }
+    return tag_entry_level(entry);
+}
+
+/* Add an entry for a tag which is not in the table, ulog_impl_lock() should be
+   called before calling this function.
+*/
+static tag_entry_t *tag_table_insert(const char *tag, uint32_t hash)
+{
+    size_t tag_len = strlen(tag) + 1;
+    size_t words = (offsetof(tag_entry_t, tag) + tag_len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    if (s_tag_count >= TAG_TABLE_MAX_ENTRIES || words > TAG_POOL_WORDS - s_tag_pool_used) {
+        return NULL;
+    }
+    uint16_t offset = (uint16_t) s_tag_pool_used;
+    s_tag_pool_used += words;
+    tag_entry_t *entry = (tag_entry_t *) &s_tag_pool[offset];
+    entry->hash = hash;
+    atomic_init(&entry->rule, 0);   // generation 0 is never current
+    atomic_init(&entry->level, TAG_LEVEL_UNSET);
+    memcpy(entry->tag, tag, tag_len); // we know the size and strncpy would trigger a compiler warning here
+
+    uint32_t i = hash & (TAG_TABLE_SIZE - 1);
+    while (atomic_load_explicit(&s_tag_table[i], memory_order_relaxed) != 0) {
+        i = (i + 1) & (TAG_TABLE_SIZE - 1);
+    }
+    atomic_store_explicit(&s_tag_table[i], offset, memory_order_release);
+    ++s_tag_count;
+
+    // the tag may be cached with the default level, under several pointers
+    // (e.g. identical literals in different files)
+    for (uint32_t slot = 0; slot < TAG_CACHE_SIZE; ++slot) {
+        const char *cached_tag = atomic_load_explicit(&s_log_cache[slot].tag, memory_order_relaxed);
+        if (cached_tag != NULL && strcmp(cached_tag, tag) == 0) {
+            cache_entry_store(&s_log_cache[slot], cached_tag, entry);
+        }
+    }
+    return entry;
+}
+
+/* ulog_impl_lock() should be called before calling this function */
+static void tag_entry_set_level(tag_entry_t *entry, uint8_t level)
+{
+    uint8_t old_level = atomic_load_explicit(&entry->level, memory_order_relaxed);
+    if (old_level != TAG_LEVEL_UNSET) {
+        --s_tag_level_counts[old_level];
+    }
+    if (level != TAG_LEVEL_UNSET) {
+        ++s_tag_level_counts[level];
+    }
+    atomic_store_explicit(&entry->level, level, memory_order_relaxed);
+}
+
+/* Entries memoize the rules by themselves, tags cached without an entry may
+   match a rule now. ulog_impl_lock() should be called before calling this function.
+*/
+static void rules_changed(void)
+{
+    uint32_t generation = atomic_load_explicit(&s_rule_generation, memory_order_relaxed) + 1;
+    if ((generation & 0xffffff) == 0) {
+        ++generation;
+    }
+    atomic_store_explicit(&s_rule_generation, generation, memory_order_release);
+    for (uint32_t slot = 0; slot < TAG_CACHE_SIZE; ++slot) {
+        if (atomic_load_explicit(&s_log_cache[slot].entry, memory_order_relaxed) == NULL) {
+            cache_entry_store(&s_log_cache[slot], NULL, NULL);
+        }
+    }
+}
+
+/* Set the level of the rule for tags starting with prefix, ulog_impl_lock()
+   should be called before calling this function. Returns false if the nodes
+   are exhausted.
+*/
+static bool rule_set(const char *prefix, size_t len, uint8_t level)
+{
+    uint16_t node = 0;
+    for (size_t k = 0; k < len; ++k) {
+        uint16_t i = atomic_load_explicit(&s_rule_nodes[node].child, memory_order_relaxed);
+        while (i != 0 && s_rule_nodes[i].c != prefix[k]) {
+            i = atomic_load_explicit(&s_rule_nodes[i].next, memory_order_relaxed);
+        }
+        if (i == 0) {
+            if (s_rule_nodes_used >= RULE_NODES) {
+                return false;
+            }
+            i = (uint16_t) s_rule_nodes_used++;
+            rule_node_t *child = &s_rule_nodes[i];
+            child->c = prefix[k];
+            atomic_store_explicit(&child->level, TAG_LEVEL_UNSET, memory_order_relaxed);
+            atomic_store_explicit(&child->child, 0, memory_order_relaxed);
+            atomic_store_explicit(&child->next, atomic_load_explicit(&s_rule_nodes[node].child, memory_order_relaxed),
+                                  memory_order_relaxed);
+            atomic_store_explicit(&s_rule_nodes[node].child, i, memory_order_release);
+        }
+        node = i;
+    }
+    uint8_t old_level = atomic_load_explicit(&s_rule_nodes[node].level, memory_order_relaxed);
+    if (old_level == TAG_LEVEL_UNSET) {
+        __atomic_store_n(&s_rule_count, s_rule_count + 1, __ATOMIC_RELAXED);
+    } else {
+        --s_tag_level_counts[old_level];
+    }
+    ++s_tag_level_counts[level];
+    atomic_store_explicit(&s_rule_nodes[node].level, level, memory_order_relaxed);
+    return true;
+}
+
+/* Drop all the rules, ulog_impl_lock() should be called before calling this function */
+static void rules_clear(void)
+{
+    if (s_rule_count == 0) {
+        return;
+    }
+    for (uint32_t i = 1; i < s_rule_nodes_used; ++i) {
+        uint8_t level = atomic_load_explicit(&s_rule_nodes[i].level, memory_order_relaxed);
+        if (level != TAG_LEVEL_UNSET) {
+            --s_tag_level_counts[level];
+        }
+    }
+    atomic_store_explicit(&s_rule_nodes[0].child, 0, memory_order_release);
+    s_rule_nodes_used = 1;
+    __atomic_store_n(&s_rule_count, 0, __ATOMIC_RELAXED);
+    rules_changed();
+}
+
 void ulog_level_set(const char *tag, ulog_level_t level)
 {
+    if (level > ULOG_VERBOSE) {
+        level = ULOG_VERBOSE;
+    }
     ulog_impl_lock();
 
-    // for wildcard tag, remove all linked list items and clear the cache
+    // for wildcard tag, every tag gets the default level again
     if (strcmp(tag, "*") == 0) {
-        ulog_default_level = level;
-        clear_log_level_list();
+        __atomic_store_n(&ulog_default_level, level, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < TAG_TABLE_SIZE; ++i) {
+            uint16_t offset = atomic_load_explicit(&s_tag_table[i], memory_order_relaxed);
+            if (offset != 0) {
+                tag_entry_set_level((tag_entry_t *) &s_tag_pool[offset], TAG_LEVEL_UNSET);
+            }
+        }
+        rules_clear();
+        update_tag_descs(NULL, level);
+        update_tag_max_level();
         ulog_impl_unlock();
         return;
     }
 
-    // search for existing tag
-    uncached_tag_entry_t *it = NULL;
-    SLIST_FOREACH(it, &s_log_tags, entries) {
-        if (strcmp(it->tag, tag) == 0) {
-            // one tag in the linked list matched, update the level
-            it->level = level;
-            // quit with it != NULL
-            break;
+    size_t len = strlen(tag);
+    if (len > 1 && tag[len - 1] == '*') {
+        if (rule_set(tag, len - 1, (uint8_t) level)) {
+            rules_changed();
+            update_rule_descs(tag, len - 1);
+            update_tag_max_level();
+        }
+        ulog_impl_unlock();
+        return;
+    }
+
+    uint32_t hash = tag_hash(tag);
+    tag_entry_t *entry = tag_table_find(tag, hash);
+    if (entry == NULL) {
+        entry = tag_table_insert(tag, hash);
+    }
+    if (entry == NULL) {
+        // table or pool full
+        ulog_impl_unlock();
+        return;
+    }
+    tag_entry_set_level(entry, (uint8_t) level);
+    update_tag_descs(tag, level);
+    update_tag_max_level();
+    ulog_impl_unlock();
+}
+
+/* Update the level slot of the static descriptors matching the tag, or of all of
+   them if tag is NULL. ulog_impl_lock() should be called before calling this function.
+*/
+static void update_tag_descs(const char *tag, ulog_level_t level)
+{
+    for (ulog_tag_desc_t *desc = __start_ulog_tags; desc < __stop_ulog_tags; ++desc) {
+        if (tag == NULL || strcmp(desc->name, tag) == 0) {
+            __atomic_store_n(&desc->level, (uint8_t) level, __ATOMIC_RELAXED);
         }
     }
-    // no existing tag, append new one
-    if (it == NULL) {
-        // allocate new linked list entry and append it to the head of the list
-        size_t tag_len = strlen(tag) + 1;
-        size_t entry_size = offsetof(uncached_tag_entry_t, tag) + tag_len;
-        uncached_tag_entry_t *new_entry = (uncached_tag_entry_t *) malloc(entry_size);
-        if (!new_entry) {
-            ulog_impl_unlock();
-            return;
+}
+
+/* Resolve again the level of the static descriptors starting with prefix, after a
+   change of its rule. ulog_impl_lock() should be called before calling this function.
+*/
+static void update_rule_descs(const char *prefix, size_t len)
+{
+    for (ulog_tag_desc_t *desc = __start_ulog_tags; desc < __stop_ulog_tags; ++desc) {
+        if (strncmp(desc->name, prefix, len) == 0) {
+            ulog_level_t level = tag_level(desc->name, tag_table_find(desc->name, tag_hash(desc->name)));
+            __atomic_store_n(&desc->level, (uint8_t) level, __ATOMIC_RELAXED);
         }
-        new_entry->level = (uint8_t) level;
-        memcpy(new_entry->tag, tag, tag_len); // we know the size and strncpy would trigger a compiler warning here
-        SLIST_INSERT_HEAD(&s_log_tags, new_entry, entries);
     }
+}
 
-    // search in the cache and update the entry it if exists
-    for (uint32_t i = 0; i < s_log_cache_entry_count; ++i) {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
+/* Recompute the upper bound used by ulog_enabled(): an entry must pass the level
+   of its tag and be accepted by a sink or by the backtrace store. ulog_impl_lock()
+   should be called before calling this function.
+*/
+static void update_max_level(void)
+{
+    ulog_level_t output_level = ulog_sinks_max_level();
+#if CONFIG_LOG_BACKTRACE
+    if (ulog_backtrace_level() > output_level) {
+        output_level = ulog_backtrace_level();
+    }
 #endif
-        if (strcmp(s_log_cache[i].tag, tag) == 0) {
-            s_log_cache[i].level = level;
+    ulog_level_t max_level = s_tag_max_level < output_level ? s_tag_max_level : output_level;
+    __atomic_store_n(&ulog_max_level, max_level, __ATOMIC_RELAXED);
+}
+
+static void update_tag_max_level(void)
+{
+    ulog_level_t max_level = ulog_default_level;
+    for (int level = ULOG_VERBOSE; level > (int) max_level; --level) {
+        if (s_tag_level_counts[level] != 0) {
+            max_level = (ulog_level_t) level;
             break;
         }
     }
-    ulog_impl_unlock();
+    s_tag_max_level = max_level;
+    update_max_level();
 }
 
+void ulog_max_level_refresh(void)
+{
+    ulog_impl_lock();
+    update_max_level();
+    ulog_impl_unlock();
+}
 
-/* Common code for getting the log level from cache, ulog_impl_lock()
+/* Slow path for getting the log level after a cache miss, ulog_impl_lock()
    should be called before calling this function. The function unlocks,
    as indicated in the name.
 */
 static ulog_level_t s_log_level_get_and_unlock(const char *tag)
 {
     ulog_level_t level_for_tag;
-    // Look for the tag in cache first, then in the linked list of all tags
+    // Another thread may have added the tag while we were waiting for the lock
     if (!get_cached_log_level(tag, &level_for_tag)) {
-        if (!get_uncached_log_level(tag, &level_for_tag)) {
-            level_for_tag = ulog_default_level;
+        uint32_t hash = tag_hash(tag);
+        tag_entry_t *entry = tag_table_find(tag, hash);
+        bool ruled = entry == NULL && s_rule_count != 0 && rule_lookup(tag) != TAG_LEVEL_UNSET;
+        if (ruled) {
+            // the entry memoizes the level given by the rule
+            entry = tag_table_insert(tag, hash);
         }
-        add_to_cache(tag, level_for_tag);
-#ifdef LOG_BUILTIN_CHECKS
-        ++s_log_cache_misses;
-#endif
+        level_for_tag = tag_level(tag, entry);
+        if (!ruled || entry != NULL) {
+            // without an entry, the cache would give the default level
+            add_to_cache(tag, entry);
+        }
+        ULOG_STATS_INC(cache_misses);
     }
     ulog_impl_unlock();
 
     return level_for_tag;
 }
 
-ulog_level_t ulog_level_get(const char *tag)
+ulog_level_t ulog_level_lookup(const char *tag)
 {
-    ulog_impl_lock();
-    return s_log_level_get_and_unlock(tag);
+    const ulog_tag_desc_t *desc = ulog_tag_desc(tag);
+    if (desc) {
+        return (ulog_level_t) __atomic_load_n(&desc->level, __ATOMIC_RELAXED);
+    }
+    ulog_level_t level_for_tag;
+    if (get_cached_log_level(tag, &level_for_tag)) {
+        ULOG_STATS_INC(cache_hits);
+        return level_for_tag;
+    }
+    ULOG_STATS_INC(cache_misses);
+    return tag_level(tag, tag_table_find(tag, tag_hash(tag)));
 }
 
-void clear_log_level_list(void)
+ulog_level_t ulog_level_get(const char *tag)
 {
-    uncached_tag_entry_t *it;
-    while ((it = SLIST_FIRST(&s_log_tags)) != NULL) {
-        SLIST_REMOVE_HEAD(&s_log_tags, entries);
-        free(it);
+    const ulog_tag_desc_t *desc = ulog_tag_desc(tag);
+    if (desc) {
+        return (ulog_level_t) __atomic_load_n(&desc->level, __ATOMIC_RELAXED);
     }
-    s_log_cache_entry_count = 0;
-    s_log_cache_max_generation = 0;
-#ifdef LOG_BUILTIN_CHECKS
-    s_log_cache_misses = 0;
-#endif
+    ulog_level_t level_for_tag;
+    // hits are not counted here, this is the check of every disabled entry
+    if (get_cached_log_level(tag, &level_for_tag)) {
+        return level_for_tag;
+    }
+    ulog_impl_lock();
+    return s_log_level_get_and_unlock(tag);
 }
 
 void ulog_writev(ulog_level_t level,
@@ -158,16 +471,27 @@ void ulog_writev(ulog_level_t level,
                    const char *format,
                    va_list args)
 {
-    if (!ulog_impl_lock_timeout()) {
-        return;
+    ulog_level_t level_for_tag;
+    const ulog_tag_desc_t *desc = ulog_tag_desc(tag);
+    if (desc) {
+        level_for_tag = (ulog_level_t) __atomic_load_n(&desc->level, __ATOMIC_RELAXED);
+    } else if (get_cached_log_level(tag, &level_for_tag)) {
+        ULOG_STATS_INC(cache_hits);
+    } else if (ulog_impl_lock_timeout()) {
+        level_for_tag = s_log_level_get_and_unlock(tag);
+    } else {
+        // the table can be searched without the lock, only the cache is not filled
+        level_for_tag = tag_level(tag, tag_table_find(tag, tag_hash(tag)));
+        ULOG_STATS_INC(cache_misses);
+        ULOG_STATS_INC(lock_timeouts);
     }
-    ulog_level_t level_for_tag = s_log_level_get_and_unlock(tag);
     if (!should_output(level, level_for_tag)) {
+        ULOG_STATS_INC(filtered[level]);
+        ulog_profile_filtered(tag);
         return;
     }
 
-    (*s_log_print_func)(format, args);
-
+    ulog_output(level, tag, format, args);
 }
 
 void ulog_write(ulog_level_t level,
@@ -180,97 +504,286 @@ void ulog_write(ulog_level_t level,
     va_end(list);
 }
 
-static inline bool get_cached_log_level(const char *tag, ulog_level_t *level)
+void ulog_write_unchecked(ulog_level_t level,
+                   const char *tag,
+                   const char *format, ...)
 {
-    // Look for `tag` in cache
-    uint32_t i;
-    for (i = 0; i < s_log_cache_entry_count; ++i) {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
+    va_list list;
+    va_start(list, format);
+    ulog_output(level, tag, format, list);
+    va_end(list);
+}
+
+static int print_formatted(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = (*s_log_print_func)(format, list);
+    va_end(list);
+    return ret;
+}
+
+void ulog_print_raw(const char *buf, size_t len)
+{
+    print_formatted("%.*s", (int) len, buf);
+}
+
+void ulog_console_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    (void) ctx;
+    (void) level;
+    if (s_log_print_func == &vprintf) {
+        fwrite(buf, 1, len, stdout);
+    } else {
+        ulog_print_raw(buf, len);
+    }
+}
+
+void ulog_ctx_release(void *arg)
+{
+    ulog_ctx_t *ctx = (ulog_ctx_t *) arg;
+#if CONFIG_LOG_ASYNC
+    if (ctx->async_ring) {
+        ulog_async_ring_release(ctx->async_ring);
+    }
 #endif
-        if (s_log_cache[i].tag == tag) {
-            break;
-        }
+    free(ctx);
+}
+
+ulog_ctx_t *ulog_ctx_get(void)
+{
+    ulog_ctx_t *ctx = (ulog_ctx_t *) ulog_impl_thread_ctx_get();
+    if (ctx != NULL) {
+        return ctx;
     }
-    if (i == s_log_cache_entry_count) { // Not found in cache
-        return false;
+    ctx = (ulog_ctx_t *) calloc(1, sizeof(ulog_ctx_t));
+    if (ctx != NULL && !ulog_impl_thread_ctx_set(ctx)) {
+        free(ctx);
+        ctx = NULL;
     }
-    // Return level from cache
-    *level = (ulog_level_t) s_log_cache[i].level;
-    // If cache has been filled, start taking ordering into account
-    // (other options are: dynamically resize cache, add "dummy" entries
-    //  to the cache; this option was chosen because code is much simpler,
-    //  and the unfair behavior of cache will show it self at most once, when
-    //  it has just been filled)
-    if (s_log_cache_entry_count == TAG_CACHE_SIZE) {
-        // Update item generation
-        s_log_cache[i].generation = s_log_cache_max_generation++;
-        // Restore heap ordering
-        heap_bubble_down(i);
+    return ctx;
+}
+
+static void output_line(ulog_level_t level, const char *tag, uint32_t sinks, bool backtrace, bool filter,
+                        char *line, size_t size, const char *format, va_list args);
+
+/* Entry logged without a log context, or from a sink while the context line is in use */
+static __attribute__((noinline)) void output_on_stack(ulog_level_t level, const char *tag, uint32_t sinks,
+                                                      bool backtrace, bool filter, const char *format, va_list args)
+{
+    char line[CONFIG_LOG_LINE_BUFFER_SIZE];
+    output_line(level, tag, sinks, backtrace, filter, line, sizeof(line), format, args);
+}
+
+/* Format the entry once and hand the same text to the backtrace store and to every
+   sink accepting it, directly or through the asynchronous output. With
+   CONFIG_LOG_LAZY_FORMAT, entries only taken by the backtrace store are not formatted.
+   The keyword filters are applied to the format first, and to the text only if
+   their verdict depends on the arguments.
+*/
+static inline void ulog_output(ulog_level_t level, const char *tag, const char *format, va_list args)
+{
+    uint32_t sinks = ulog_sinks_accept(level, tag) & ~ulog_sinks_structured();
+#if CONFIG_LOG_BACKTRACE
+    bool backtrace = level <= ulog_backtrace_level();
+#else
+    const bool backtrace = false;
+#endif
+    if (sinks == 0 && !backtrace) {
+        ULOG_STATS_INC(filtered[level]);
+        ulog_profile_filtered(tag);
+        return;
+    }
+#if CONFIG_LOG_FILTER
+    ulog_filter_verdict_t verdict = ulog_filter_format(format);
+    if (verdict == ULOG_FILTER_DROP) {
+        ULOG_STATS_INC(filtered[level]);
+        ulog_profile_filtered(tag);
+        return;
+    }
+    bool filter = verdict == ULOG_FILTER_TEXT;
+#else
+    const bool filter = false;
+#endif
+    if (!filter) {
+        ULOG_STATS_INC(emitted[level]);
+    }
+#if CONFIG_LOG_BACKTRACE && CONFIG_LOG_LAZY_FORMAT
+    if (sinks == 0 && !filter) {
+        // only kept in the backtrace store, formatted if it is ever read
+        uint32_t start = ulog_profile_cycles();
+        ulog_backtrace_writev(level, tag, format, args);
+        ulog_profile_entry(tag, 0, ulog_profile_cycles() - start, 0);
+        return;
+    }
+#endif
+
+    ulog_ctx_t *ctx = ulog_ctx_get();
+    if (ctx == NULL || ctx->busy) {
+        output_on_stack(level, tag, sinks, backtrace, filter, format, args);
+        return;
+    }
+    ctx->busy = true;
+    output_line(level, tag, sinks, backtrace, filter, ctx->line, sizeof(ctx->line), format, args);
+    ctx->busy = false;
+}
+
+/* Apply the keyword filters to the text of an entry whose format did not decide */
+static inline bool filter_text(ulog_level_t level, bool filter, const char *format, const char *line, size_t len)
+{
+#if CONFIG_LOG_FILTER
+    if (filter) {
+        if (!ulog_filter_text(format, line, len)) {
+            ULOG_STATS_INC(filtered[level]);
+            return false;
+        }
+        ULOG_STATS_INC(emitted[level]);
     }
+#else
+    (void) level;
+    (void) filter;
+    (void) format;
+    (void) line;
+    (void) len;
+#endif
     return true;
 }
 
-static inline void add_to_cache(const char *tag, ulog_level_t level)
+static void output_line(ulog_level_t level, const char *tag, uint32_t sinks, bool backtrace, bool filter,
+                        char *line, size_t size, const char *format, va_list args)
 {
-    uint32_t generation = s_log_cache_max_generation++;
-    // First consider the case when cache is not filled yet.
-    // In this case, just add new entry at the end.
-    // This happens to satisfy binary min-heap ordering.
-    if (s_log_cache_entry_count < TAG_CACHE_SIZE) {
-        s_log_cache[s_log_cache_entry_count] = (cached_tag_entry_t) {
-            .generation = generation,
-            .level = level,
-            .tag = tag
-        };
-        ++s_log_cache_entry_count;
+    uint32_t start = ulog_profile_cycles();
+    va_list copy;
+    va_copy(copy, args);
+    int ret = ulog_format_vsnprintf(line, size, format, args);
+    if (ret <= 0) {
+        va_end(copy);
         return;
     }
+    size_t len = (size_t) ret;
+    char *long_line = NULL;
+    if (len >= size) {
+        // longer than the line buffer, e.g. ULOG_BUFFER_HEXDUMP_BLOCK()
+        long_line = (char *) malloc(len + 1);
+        if (long_line != NULL) {
+            ulog_format_vsnprintf(long_line, len + 1, format, copy);
+            line = long_line;
+        } else {
+            // keep the entry on its own line
+            len = size - 1;
+            line[len - 1] = '\n';
+        }
+    }
+    va_end(copy);
+    if (filter_text(level, filter, format, line, len)) {
+        uint32_t formatted = ulog_profile_cycles();
+        ulog_dispatch(level, sinks, backtrace, line, len);
+        ulog_profile_entry(tag, len, formatted - start, ulog_profile_cycles() - formatted);
+    } else {
+        ulog_profile_filtered(tag);
+    }
+    free(long_line);
+}
 
-    // Cache is full, so we replace the oldest entry (which is at index 0
-    // because this is a min-heap) with the new one, and do bubble-down
-    // operation to restore min-heap ordering.
-    s_log_cache[0] = (cached_tag_entry_t) {
-        .tag = tag,
-        .level = level,
-        .generation = generation
-    };
-    heap_bubble_down(0);
+void ulog_output_text(ulog_level_t level, const char *tag, const char *buf, size_t len)
+{
+    uint32_t sinks = ulog_sinks_accept(level, tag) & ~ulog_sinks_structured();
+#if CONFIG_LOG_BACKTRACE
+    bool backtrace = level <= ulog_backtrace_level();
+#else
+    const bool backtrace = false;
+#endif
+    if (sinks == 0 && !backtrace) {
+        ULOG_STATS_INC(filtered[level]);
+        ulog_profile_filtered(tag);
+        return;
+    }
+    ULOG_STATS_INC(emitted[level]);
+    uint32_t start = ulog_profile_cycles();
+    ulog_dispatch(level, sinks, backtrace, buf, len);
+    ulog_profile_entry(tag, len, 0, ulog_profile_cycles() - start);
 }
 
-static inline bool get_uncached_log_level(const char *tag, ulog_level_t *level)
+void ulog_dispatch(ulog_level_t level, uint32_t sinks, bool backtrace, const char *line, size_t len)
 {
-    // Walk the linked list of all tags and see if given tag is present in the list.
-    // This is slow because tags are compared as strings.
-    uncached_tag_entry_t *it;
-    SLIST_FOREACH(it, &s_log_tags, entries) {
-        if (strcmp(tag, it->tag) == 0) {
-            *level = it->level;
-            return true;
-        }
+#if CONFIG_LOG_BACKTRACE
+    if (backtrace) {
+        ulog_backtrace_write(level, line, len);
+    }
+#else
+    (void) backtrace;
+#endif
+    if (sinks == 0) {
+        return;
+    }
+#if CONFIG_LOG_ASYNC
+    if (ulog_async_write(level, sinks, line, len)) {
+        return;
     }
-    return false;
+#endif
+    ulog_sinks_write(sinks, level, line, len);
 }
 
-static inline bool should_output(ulog_level_t level_for_message, ulog_level_t level_for_tag)
+static inline cached_tag_entry_t *cache_entry_for(const char *tag)
 {
-    return level_for_message <= level_for_tag;
+    // Fibonacci hashing of the pointer, low bits of string addresses carry little entropy
+    uint32_t hash = (uint32_t) ((uintptr_t) tag ^ ((uintptr_t) tag >> 16)) * 2654435769u;
+    return &s_log_cache[hash >> (32 - TAG_CACHE_BITS)];
+}
+
+static inline bool get_cached_log_level(const char *tag, ulog_level_t *level)
+{
+    cached_tag_entry_t *slot = cache_entry_for(tag);
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq & 1) { // Slot is being updated
+        return false;
+    }
+    const char *cached_tag = atomic_load_explicit(&slot->tag, memory_order_relaxed);
+    tag_entry_t *entry = atomic_load_explicit(&slot->entry, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (cached_tag != tag || atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+        return false;
+    }
+    // the level is read from the entry, so that ulog_level_set() does not touch the cache
+    *level = tag_entry_level(entry);
+    return true;
+}
+
+static inline void add_to_cache(const char *tag, tag_entry_t *entry)
+{
+    // The slot may hold another tag, which is simply evicted
+    cache_entry_store(cache_entry_for(tag), tag, entry);
+}
+
+static inline void cache_entry_store(cached_tag_entry_t *slot, const char *tag, tag_entry_t *entry)
+{
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+#ifdef LOG_BUILTIN_CHECKS
+    assert((seq & 1) == 0);
+#endif
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->tag, tag, memory_order_relaxed);
+    atomic_store_explicit(&slot->entry, entry, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
 }
 
-static void heap_bubble_down(int index)
+/* The table is only appended to, it can be searched without the lock */
+static inline tag_entry_t *tag_table_find(const char *tag, uint32_t hash)
 {
-    while (index < TAG_CACHE_SIZE / 2) {
-        int left_index = index * 2 + 1;
-        int right_index = left_index + 1;
-        int next = (s_log_cache[left_index].generation < s_log_cache[right_index].generation) ? left_index : right_index;
-        heap_swap(index, next);
-        index = next;
+    for (uint32_t i = hash & (TAG_TABLE_SIZE - 1); ; i = (i + 1) & (TAG_TABLE_SIZE - 1)) {
+        uint16_t offset = atomic_load_explicit(&s_tag_table[i], memory_order_acquire);
+        if (offset == 0) {
+            return NULL;
+        }
+        tag_entry_t *entry = (tag_entry_t *) &s_tag_pool[offset];
+        if (entry->hash == hash && strcmp(entry->tag, tag) == 0) {
+            return entry;
+        }
     }
 }
 
-static inline void heap_swap(int i, int j)
+static inline bool should_output(ulog_level_t level_for_message, ulog_level_t level_for_tag)
 {
-    cached_tag_entry_t tmp = s_log_cache[i];
-    s_log_cache[i] = s_log_cache[j];
-    s_log_cache[j] = tmp;
+    return level_for_message <= level_for_tag;
 }
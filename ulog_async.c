@@ -0,0 +1,340 @@
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_ASYNC
+
+/* Every thread owns a single producer, single consumer ring of records, the drain
+   task is the only consumer of all of them. Records are 8-byte aligned and never
+   wrap: when a record does not fit before the end of the buffer, a padding record
+   fills the tail and the record is written at the beginning.
+
+   A thread runs on one core at a time, so the cache lines of a ring are only shared
+   with the drain task, which merges the rings in the order of the timestamps of
+   their records.
+*/
+
+#define RECORD_ALIGN(len) (((len) + 7) & ~(size_t) 7)
+#define RECORD_PADDING    0xffff
+
+// Size of the buffer used by the drain task to write several records at once
+#define BATCH_SIZE 2048
+
+typedef struct {
+    uint16_t len;       // length of the text, or RECORD_PADDING
+    uint8_t level;      // ulog_level_t as uint8_t
+    uint8_t reserved;
+    uint32_t sinks;     // sinks accepting the entry, see ulog_sinks_accept()
+    uint32_t time_us;   // ulog_impl_time_us() when the record was written
+} async_record_t;
+
+typedef enum {
+    RING_OWNED,         // in use by a thread
+    RING_ORPHANED,      // owner thread exited, drain it then release it
+    RING_FREE,          // can be adopted by a new thread
+} ring_state_t;
+
+typedef struct async_ring_ {
+    struct async_ring_ *next;
+    atomic_uint state;
+    atomic_size_t head;     // written by the producer
+    atomic_size_t tail;     // written by the consumer
+    // used by async_drain() only
+    size_t drain_tail;
+    size_t drain_head;
+    unsigned drain_state;
+    size_t size;
+    char buf[];
+} async_ring_t;
+
+static struct {
+    atomic_bool running;
+    atomic_bool sleeping;
+    atomic_flag draining;
+    atomic_uint dropped;
+    _Atomic(async_ring_t *) rings;
+    size_t ring_size;
+    ulog_async_policy_t policy;
+    size_t batch_len;
+    uint32_t batch_sinks;
+    ulog_level_t batch_level;   // most severe level in the batch
+    char batch[BATCH_SIZE];
+} s_async = {
+    .draining = ATOMIC_FLAG_INIT,
+};
+
+static async_ring_t *s_drain_ring_marker;   // thread context of the drain task
+
+static void async_task(void *arg);
+static void async_drain(void);
+
+bool ulog_async_start(const ulog_async_config_t *config)
+{
+    const ulog_async_config_t default_config = ULOG_ASYNC_CONFIG_DEFAULT();
+    if (config == NULL) {
+        config = &default_config;
+    }
+    if (atomic_load(&s_async.running)) {
+        return true;
+    }
+    size_t ring_size = 64;
+    while (ring_size < config->ring_size) {
+        ring_size <<= 1;
+    }
+    s_async.ring_size = ring_size;
+    s_async.policy = config->policy;
+    atomic_store(&s_async.dropped, 0);
+    if (!ulog_impl_async_start(&async_task, NULL)) {
+        return false;
+    }
+    atomic_store(&s_async.running, true);
+    return true;
+}
+
+uint32_t ulog_async_dropped(void)
+{
+    return atomic_load_explicit(&s_async.dropped, memory_order_relaxed);
+}
+
+static void async_flush(void)
+{
+    while (atomic_flag_test_and_set_explicit(&s_async.draining, memory_order_acquire)) {
+        ulog_impl_yield();
+    }
+    async_drain();
+    atomic_flag_clear_explicit(&s_async.draining, memory_order_release);
+}
+
+void ulog_async_flush(void)
+{
+    // counts of the rate limit, not on every pass of the drain task which would defeat it
+    ulog_suppressed_flush();
+    async_flush();
+}
+
+void ulog_async_ring_release(void *arg)
+{
+    async_ring_t *ring = (async_ring_t *) arg;
+    if (ring != s_drain_ring_marker) {
+        atomic_store_explicit(&ring->state, RING_ORPHANED, memory_order_release);
+    }
+}
+
+static async_ring_t *ring_get(void)
+{
+    ulog_ctx_t *ctx = ulog_ctx_get();
+    if (ctx == NULL) {
+        return NULL;
+    }
+    async_ring_t *ring = (async_ring_t *) ctx->async_ring;
+    if (ring != NULL) {
+        return ring;
+    }
+    // adopt a ring left by a thread which exited
+    for (ring = atomic_load_explicit(&s_async.rings, memory_order_acquire); ring != NULL; ring = ring->next) {
+        unsigned expected = RING_FREE;
+        if (ring->size >= s_async.ring_size &&
+                atomic_compare_exchange_strong(&ring->state, &expected, RING_OWNED)) {
+            ctx->async_ring = ring;
+            return ring;
+        }
+    }
+    ring = (async_ring_t *) calloc(1, sizeof(async_ring_t) + s_async.ring_size);
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->size = s_async.ring_size;
+    atomic_init(&ring->state, RING_OWNED);
+    ring->next = atomic_load_explicit(&s_async.rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&s_async.rings, &ring->next, ring,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+    ctx->async_ring = ring;
+    return ring;
+}
+
+/* Copy the entry at the head of the ring. Returns false if there is not enough room. */
+static bool ring_write(async_ring_t *ring, ulog_level_t level, uint32_t sinks, const char *buf, size_t len)
+{
+    const size_t mask = ring->size - 1;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t free = ring->size - (head - tail);
+    size_t contiguous = ring->size - (head & mask);
+    size_t room = (free < contiguous ? free : contiguous);
+
+    size_t need = RECORD_ALIGN(sizeof(async_record_t) + len);
+
+    if (need > room) {
+        // wrap around if the record fits at the beginning of the buffer
+        if (contiguous >= free || free - contiguous < need) {
+            return false;
+        }
+        async_record_t *padding = (async_record_t *) (ring->buf + (head & mask));
+        padding->len = RECORD_PADDING;
+        head += contiguous;
+    }
+    async_record_t *record = (async_record_t *) (ring->buf + (head & mask));
+    char *text = (char *) (record + 1);
+    memcpy(text, buf, len);
+    record->len = (uint16_t) len;
+    record->level = (uint8_t) level;
+    record->sinks = sinks;
+    record->time_us = ulog_impl_time_us();
+    atomic_store_explicit(&ring->head, head + need, memory_order_release);
+
+    // wake up the drain task early if the ring is filling up or the entry is an error
+    if (head + need - tail > ring->size / 2 || level == ULOG_ERROR) {
+        ulog_async_wake();
+    }
+    return true;
+}
+
+bool ulog_async_write(ulog_level_t level, uint32_t sinks, const char *buf, size_t len)
+{
+    if (!atomic_load_explicit(&s_async.running, memory_order_relaxed)) {
+        return false;
+    }
+    async_ring_t *ring = ring_get();
+    if (ring == NULL || ring == s_drain_ring_marker) {
+        // no log context, or called from an output function: write synchronously
+        return false;
+    }
+    if (len > ring->size / 2 - sizeof(async_record_t) || len >= RECORD_PADDING) {
+        // too long for a record, write it synchronously after the queued entries
+        async_flush();
+        return false;
+    }
+    while (!ring_write(ring, level, sinks, buf, len)) {
+        if (s_async.policy == ULOG_ASYNC_DROP) {
+            atomic_fetch_add_explicit(&s_async.dropped, 1, memory_order_relaxed);
+            return true;
+        }
+        ulog_async_wake();
+        ulog_impl_yield();
+    }
+    return true;
+}
+
+void ulog_async_wake(void)
+{
+    if (atomic_exchange_explicit(&s_async.sleeping, false, memory_order_relaxed)) {
+        ulog_impl_async_notify();
+    }
+}
+
+static void batch_flush(void)
+{
+    if (s_async.batch_len > 0) {
+        ulog_sinks_write(s_async.batch_sinks, s_async.batch_level, s_async.batch, s_async.batch_len);
+        s_async.batch_len = 0;
+    }
+}
+
+/* Consecutive records going to the same sinks are written at once */
+static void batch_append(const async_record_t *record)
+{
+    const char *text = (const char *) (record + 1);
+    size_t len = record->len;
+    ulog_level_t level = (ulog_level_t) record->level;
+    if (s_async.batch_len + len > BATCH_SIZE || record->sinks != s_async.batch_sinks) {
+        batch_flush();
+    }
+    if (len > BATCH_SIZE) {
+        ulog_sinks_write(record->sinks, level, text, len);
+        return;
+    }
+    if (s_async.batch_len == 0) {
+        s_async.batch_sinks = record->sinks;
+        s_async.batch_level = level;
+    } else if (level < s_async.batch_level) {
+        s_async.batch_level = level;
+    }
+    memcpy(s_async.batch + s_async.batch_len, text, len);
+    s_async.batch_len += len;
+}
+
+/* Next record of a ring to drain, NULL if there is none */
+static const async_record_t *drain_next(async_ring_t *ring)
+{
+    const size_t mask = ring->size - 1;
+    while (ring->drain_tail != ring->drain_head) {
+        const async_record_t *record = (const async_record_t *) (ring->buf + (ring->drain_tail & mask));
+        if (record->len != RECORD_PADDING) {
+            return record;
+        }
+        ring->drain_tail += ring->size - (ring->drain_tail & mask);
+    }
+    return NULL;
+}
+
+/* Consume all the records available, oldest first, the caller must hold s_async.draining */
+static void async_drain(void)
+{
+#if CONFIG_LOG_ISR
+    ulog_isr_drain();
+#endif
+    // rings added meanwhile are drained next time
+    async_ring_t *rings = atomic_load_explicit(&s_async.rings, memory_order_acquire);
+    for (async_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+        ring->drain_state = atomic_load_explicit(&ring->state, memory_order_acquire);
+        ring->drain_tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        ring->drain_head = ring->drain_state == RING_FREE ? ring->drain_tail :
+                           atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    while (true) {
+        async_ring_t *oldest = NULL;
+        const async_record_t *oldest_record = NULL;
+        for (async_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+            const async_record_t *record = drain_next(ring);
+            // on a tie, the ring first in the list goes first
+            if (record != NULL && (oldest == NULL || (int32_t) (record->time_us - oldest_record->time_us) < 0)) {
+                oldest = ring;
+                oldest_record = record;
+            }
+        }
+        if (oldest == NULL) {
+            break;
+        }
+        batch_append(oldest_record);
+        oldest->drain_tail += RECORD_ALIGN(sizeof(async_record_t) + oldest_record->len);
+        // the record is copied, its room goes back to the producer right away
+        atomic_store_explicit(&oldest->tail, oldest->drain_tail, memory_order_release);
+    }
+    for (async_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+        if (ring->drain_state == RING_FREE) {
+            continue;
+        }
+        atomic_store_explicit(&ring->tail, ring->drain_tail, memory_order_release);
+        if (ring->drain_state == RING_ORPHANED) {
+            atomic_store_explicit(&ring->state, RING_FREE, memory_order_release);
+        }
+    }
+    batch_flush();
+}
+
+static void async_task(void *arg)
+{
+    (void) arg;
+    // entries logged by the output function itself are written synchronously
+    s_drain_ring_marker = (async_ring_t *) &s_async;
+    ulog_ctx_t *ctx = ulog_ctx_get();
+    if (ctx != NULL) {
+        ctx->async_ring = s_drain_ring_marker;
+    }
+    while (true) {
+        atomic_store_explicit(&s_async.sleeping, true, memory_order_relaxed);
+        ulog_impl_async_wait(CONFIG_LOG_ASYNC_FLUSH_PERIOD_MS);
+        atomic_store_explicit(&s_async.sleeping, false, memory_order_relaxed);
+        async_flush();
+        ulog_sinks_poll();
+    }
+}
+
+#endif // CONFIG_LOG_ASYNC
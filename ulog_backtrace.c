@@ -0,0 +1,305 @@
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_BACKTRACE
+
+#define BACKTRACE_MAGIC 0x554c4f47    // "ULOG"
+
+/* The store is an array of fixed-size slots, the slot of an entry is its sequence
+   number modulo the number of slots. The state word of a slot is the sequence
+   number shifted left by one, with bit 0 set while the slot is being written.
+*/
+#define SLOT_BUSY 1u
+
+// flags of a slot
+#define SLOT_BINARY 1u      // text holds a binary record (see ulog_set_binary_output()), not the formatted entry
+
+typedef struct {
+    atomic_uint state;
+    uint32_t timestamp;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t len;
+    char text[CONFIG_LOG_BACKTRACE_SLOT_SIZE - 12];
+} backtrace_slot_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    atomic_uint head;       // sequence number of the next entry
+    backtrace_slot_t slots[CONFIG_LOG_BACKTRACE_SLOTS];
+} backtrace_store_t;
+
+_Static_assert(sizeof(backtrace_slot_t) == CONFIG_LOG_BACKTRACE_SLOT_SIZE,
+               "CONFIG_LOG_BACKTRACE_SLOT_SIZE must be a multiple of 4");
+
+// Not initialized at startup, so that entries survive a reset
+static backtrace_store_t s_store __attribute__((section(".ulog_noinit")));
+
+static atomic_int s_store_ready;    // 0: not checked yet, 1: being checked, 2: ready
+static atomic_uchar s_backtrace_level = CONFIG_LOG_BACKTRACE_LEVEL;
+
+static bool store_ready(void)
+{
+    int ready = atomic_load_explicit(&s_store_ready, memory_order_acquire);
+    if (ready == 2) {
+        return true;
+    }
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&s_store_ready, &expected, 1)) {
+        // another thread is checking the store, skip this entry
+        return false;
+    }
+    if (s_store.magic != BACKTRACE_MAGIC || s_store.slot_count != CONFIG_LOG_BACKTRACE_SLOTS ||
+            s_store.slot_size != CONFIG_LOG_BACKTRACE_SLOT_SIZE) {
+        // content left by a previous run is garbage or has another layout
+        memset(&s_store, 0, sizeof(s_store));
+        s_store.slot_count = CONFIG_LOG_BACKTRACE_SLOTS;
+        s_store.slot_size = CONFIG_LOG_BACKTRACE_SLOT_SIZE;
+        s_store.magic = BACKTRACE_MAGIC;
+    }
+    atomic_store_explicit(&s_store_ready, 2, memory_order_release);
+    return true;
+}
+
+void ulog_backtrace_level_set(ulog_level_t level)
+{
+    atomic_store_explicit(&s_backtrace_level, (uint8_t) level, memory_order_relaxed);
+    ulog_max_level_refresh();
+}
+
+ulog_level_t ulog_backtrace_level(void)
+{
+    return (ulog_level_t) atomic_load_explicit(&s_backtrace_level, memory_order_relaxed);
+}
+
+/* Two writers whose sequence numbers are a multiple of the number of slots apart
+   get the same slot, e.g. when a task is preempted while others log. A writer does
+   not take a slot which is still being written or holds a newer entry, its entry is
+   then lost, and only publishes its entry if the slot still holds its own busy mark,
+   so that a torn entry is never read back as valid. */
+static backtrace_slot_t *slot_claim(uint32_t seq)
+{
+    backtrace_slot_t *slot = &s_store.slots[seq % CONFIG_LOG_BACKTRACE_SLOTS];
+    // acquire: the previous entry of the slot is complete before it is overwritten
+    unsigned state = atomic_load_explicit(&slot->state, memory_order_acquire);
+    do {
+        // distance in sequence numbers of 31 bits, as held by the state
+        if ((state & SLOT_BUSY) || (((state >> 1) - seq) & 0x7fffffffu) - 1 < 0x3fffffffu) {
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&slot->state, &state, (seq << 1) | SLOT_BUSY,
+                                                    memory_order_acquire, memory_order_acquire));
+    atomic_thread_fence(memory_order_release);
+    return slot;
+}
+
+static void slot_publish(backtrace_slot_t *slot, uint32_t seq)
+{
+    unsigned busy = (seq << 1) | SLOT_BUSY;
+    atomic_compare_exchange_strong_explicit(&slot->state, &busy, seq << 1, memory_order_release, memory_order_relaxed);
+}
+
+void ulog_backtrace_write(ulog_level_t level, const char *buf, size_t len)
+{
+    if (level > atomic_load_explicit(&s_backtrace_level, memory_order_relaxed) || !store_ready()) {
+        return;
+    }
+    uint32_t seq = atomic_fetch_add_explicit(&s_store.head, 1, memory_order_relaxed);
+    backtrace_slot_t *slot = slot_claim(seq);
+    if (slot == NULL) {
+        return;     // slot taken by another writer
+    }
+    slot->timestamp = ulog_timestamp();
+    slot->level = (uint8_t) level;
+    slot->flags = 0;
+    if (len > sizeof(slot->text)) {
+        memcpy(slot->text, buf, sizeof(slot->text) - 1);
+        len = sizeof(slot->text);
+        slot->text[len - 1] = '\n';
+    } else {
+        memcpy(slot->text, buf, len);
+    }
+    slot->len = (uint16_t) len;
+    slot_publish(slot, seq);
+}
+
+#if CONFIG_LOG_LAZY_FORMAT
+void ulog_backtrace_writev(ulog_level_t level, const char *tag, const char *format, va_list args)
+{
+    if (level > atomic_load_explicit(&s_backtrace_level, memory_order_relaxed) || !store_ready()) {
+        return;
+    }
+    uint32_t seq = atomic_fetch_add_explicit(&s_store.head, 1, memory_order_relaxed);
+    backtrace_slot_t *slot = slot_claim(seq);
+    if (slot == NULL) {
+        return;     // slot taken by another writer
+    }
+    va_list copy;
+    va_copy(copy, args);
+    size_t len = ulog_binary_encode(slot->text, sizeof(slot->text), level, tag, format, args);
+    memcpy(&slot->timestamp, slot->text + 4, sizeof(slot->timestamp));
+    slot->level = (uint8_t) level;
+    if (slot->text[1] & ULOG_BINARY_TRUNCATED) {
+        // the arguments take more room than the slot, keep what fits of the text
+        int ret = ulog_format_vsnprintf(slot->text, sizeof(slot->text), format, copy);
+        len = ret < 0 ? 0 : (size_t) ret;
+        if (len >= sizeof(slot->text)) {
+            len = sizeof(slot->text);
+            slot->text[len - 1] = '\n';
+        }
+        slot->flags = 0;
+    } else {
+        slot->flags = SLOT_BINARY;
+    }
+    va_end(copy);
+    slot->len = (uint16_t) len;
+    slot_publish(slot, seq);
+}
+#endif // CONFIG_LOG_LAZY_FORMAT
+
+/* Text of a binary slot, truncated like the formatted entries */
+static size_t format_binary_slot(char *text, size_t size, const char *data, size_t len)
+{
+    ulog_binary_record_t record;
+    if (!ulog_binary_decode(data, len, &record)) {
+        return 0;
+    }
+    len = ulog_binary_format(text, size, &record);
+    if (len == size - 1) {
+        text[len++] = '\n';
+    }
+    return len;
+}
+
+/* Criteria of ulog_query() */
+typedef struct {
+    uint32_t from_ts;
+    uint32_t to_ts;
+    ulog_level_t level;
+    const char *tag;
+    size_t tag_len;
+} query_t;
+
+static inline bool query_accepts(const query_t *query, const ulog_backtrace_record_t *record)
+{
+    return record->level != ULOG_NONE && record->level <= query->level &&
+           record->timestamp >= query->from_ts && record->timestamp <= query->to_ts;
+}
+
+/* Tag of a slot, read from the binary record or from the prefix of the text */
+static bool query_tag_matches(const query_t *query, const char *text, size_t len, bool binary)
+{
+    if (binary) {
+        ulog_binary_record_t record;
+        return ulog_binary_decode(text, len, &record) && strcmp(record.tag, query->tag) == 0;
+    }
+    ulog_entry_prefix_t prefix;
+    return ulog_entry_parse(text, len, &prefix) && prefix.tag_len == query->tag_len &&
+           memcmp(prefix.tag, query->tag, query->tag_len) == 0;
+}
+
+/* Slots are checked against the query before being copied, and before binary
+   records are formatted */
+static size_t store_foreach(size_t count, const query_t *query, ulog_backtrace_cb_t cb, void *arg)
+{
+    if (!store_ready()) {
+        return 0;
+    }
+    uint32_t head = atomic_load_explicit(&s_store.head, memory_order_acquire);
+    uint32_t stored = head < CONFIG_LOG_BACKTRACE_SLOTS ? head : CONFIG_LOG_BACKTRACE_SLOTS;
+    if (count == 0 || count > stored) {
+        count = stored;
+    }
+    size_t done = 0;
+    for (uint32_t seq = head - (uint32_t) count; seq != head; ++seq) {
+        const backtrace_slot_t *slot = &s_store.slots[seq % CONFIG_LOG_BACKTRACE_SLOTS];
+        uint32_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (state != (seq << 1)) {
+            // being written, overwritten by a newer entry, or lost in a reset
+            continue;
+        }
+        char text[sizeof(slot->text)];
+        uint8_t flags = slot->flags;
+        ulog_backtrace_record_t record = {
+            .seq = seq,
+            .timestamp = slot->timestamp,
+            .level = (ulog_level_t) slot->level,
+            .text = text,
+            .len = slot->len < sizeof(text) ? slot->len : sizeof(text),
+        };
+        if (query != NULL && !query_accepts(query, &record)) {
+            continue;
+        }
+        memcpy(text, slot->text, record.len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_relaxed) != state) {
+            continue;
+        }
+        if (query != NULL && query->tag != NULL &&
+            !query_tag_matches(query, text, record.len, flags & SLOT_BINARY)) {
+            continue;
+        }
+        if (flags & SLOT_BINARY) {
+            char data[sizeof(slot->text)];
+            memcpy(data, text, record.len);
+            record.len = format_binary_slot(text, sizeof(text), data, record.len);
+        }
+        ++done;
+        if (!cb(&record, arg)) {
+            break;
+        }
+    }
+    return done;
+}
+
+size_t ulog_backtrace_foreach(size_t count, ulog_backtrace_cb_t cb, void *arg)
+{
+    return store_foreach(count, NULL, cb, arg);
+}
+
+size_t ulog_query(uint32_t from_ts, uint32_t to_ts, ulog_level_t level, const char *tag,
+                  ulog_backtrace_cb_t cb, void *arg)
+{
+    query_t query = {
+        .from_ts = from_ts,
+        .to_ts = to_ts,
+        .level = level,
+        .tag = tag,
+        .tag_len = tag ? strlen(tag) : 0,
+    };
+    return store_foreach(0, &query, cb, arg);
+}
+
+static bool dump_record(const ulog_backtrace_record_t *record, void *arg)
+{
+    (void) arg;
+    ulog_print_raw(record->text, record->len);
+    return true;
+}
+
+void ulog_backtrace_dump(size_t count)
+{
+    ulog_backtrace_foreach(count, &dump_record, NULL);
+}
+
+void ulog_backtrace_clear(void)
+{
+    if (!store_ready()) {
+        return;
+    }
+    // the state of an entry one round before the first one, never read back
+    for (uint32_t i = 0; i < CONFIG_LOG_BACKTRACE_SLOTS; ++i) {
+        atomic_store_explicit(&s_store.slots[i].state, (i - CONFIG_LOG_BACKTRACE_SLOTS) << 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&s_store.head, 0, memory_order_release);
+}
+
+#endif // CONFIG_LOG_BACKTRACE
@@ -0,0 +1,430 @@
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t size;
+    bool truncated;
+} record_writer_t;
+
+static void binary_output_stdout(const void *data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+}
+
+static ulog_binary_output_t s_binary_output = &binary_output_stdout;
+
+ulog_binary_output_t ulog_set_binary_output(ulog_binary_output_t func)
+{
+    ulog_impl_lock();
+    ulog_binary_output_t orig_func = s_binary_output;
+    s_binary_output = func;
+    ulog_impl_unlock();
+    return orig_func;
+}
+
+static inline void put(record_writer_t *w, const void *data, size_t len)
+{
+    if (w->len + len > w->size) {
+        w->truncated = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static inline void put_str(record_writer_t *w, const char *str, size_t max_len)
+{
+    size_t len = (max_len == SIZE_MAX) ? strlen(str) : strnlen(str, max_len);
+    if (w->len + len + 1 > w->size) {
+        // keep the string terminated, cut it to what fits
+        w->truncated = true;
+        if (w->len >= w->size) {
+            return;
+        }
+        len = w->size - w->len - 1;
+    }
+    memcpy(w->buf + w->len, str, len);
+    w->buf[w->len + len] = '\0';
+    w->len += len + 1;
+}
+
+size_t ulog_binary_encode(void *buf, size_t size, ulog_level_t level, const char *tag,
+                          const char *format, va_list args)
+{
+    record_writer_t w = {
+        .buf = (uint8_t *) buf,
+        .size = size,
+    };
+    uint8_t header[4] = { ULOG_BINARY_SYNC, (uint8_t) level, 0, 0 };
+    put(&w, header, sizeof(header));
+    uint32_t timestamp = ulog_timestamp();
+    put(&w, &timestamp, sizeof(timestamp));
+
+    uintptr_t fmt_offset = (uintptr_t) format - (uintptr_t) __start_ulog_fmt;
+    if (fmt_offset < (uintptr_t) __stop_ulog_fmt - (uintptr_t) __start_ulog_fmt) {
+        uint32_t fmt_id = (uint32_t) fmt_offset;
+        put(&w, &fmt_id, sizeof(fmt_id));
+    } else {
+        header[1] |= ULOG_BINARY_FMT_INLINE;
+        put_str(&w, format, SIZE_MAX);
+    }
+    const ulog_tag_desc_t *desc = ulog_tag_desc(tag);
+    if (desc) {
+        uint16_t tag_id = (uint16_t) (desc - __start_ulog_tags);
+        put(&w, &tag_id, sizeof(tag_id));
+    } else {
+        header[1] |= ULOG_BINARY_TAG_INLINE;
+        put_str(&w, tag, ULOG_TAG_NAME_MAX);
+    }
+
+    ulog_fmt_spec_t spec;
+    while (!w.truncated && ulog_fmt_next(&format, &spec)) {
+        if (spec.width_arg) {
+            int width = va_arg(args, int);
+            put(&w, &width, sizeof(width));
+        }
+        int precision = spec.precision;
+        if (spec.precision_arg) {
+            precision = va_arg(args, int);
+            put(&w, &precision, sizeof(precision));
+        }
+        switch (spec.type) {
+        case ULOG_ARG_NONE:
+            break;
+        case ULOG_ARG_INT: {
+            int value = va_arg(args, int);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_LONG: {
+            long value = va_arg(args, long);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_LLONG: {
+            long long value = va_arg(args, long long);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_INTMAX: {
+            intmax_t value = va_arg(args, intmax_t);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_SIZE: {
+            size_t value = va_arg(args, size_t);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_PTRDIFF: {
+            ptrdiff_t value = va_arg(args, ptrdiff_t);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_PTR: {
+            void *value = va_arg(args, void *);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_DOUBLE: {
+            double value = va_arg(args, double);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_LDOUBLE: {
+            double value = (double) va_arg(args, long double);
+            put(&w, &value, sizeof(value));
+            break;
+        }
+        case ULOG_ARG_STR: {
+            const char *value = va_arg(args, const char *);
+            size_t max_len = CONFIG_LOG_BINARY_STRING_MAX;
+            if (precision >= 0 && (size_t) precision < max_len) {
+                max_len = (size_t) precision;
+            }
+            put_str(&w, value ? value : "(null)", max_len);
+            break;
+        }
+        }
+    }
+
+    if (w.truncated) {
+        header[1] |= ULOG_BINARY_TRUNCATED;
+    }
+    uint16_t len = (uint16_t) w.len;
+    memcpy(&header[2], &len, sizeof(len));
+    memcpy(w.buf, header, sizeof(header));
+    return w.len;
+}
+
+void ulog_writev_binary(ulog_level_t level, const char *tag, const char *format, va_list args)
+{
+    if (!ulog_enabled(tag, level)) {
+        ULOG_STATS_INC(filtered[level]);
+        return;
+    }
+    uint8_t record[CONFIG_LOG_BINARY_RECORD_MAX];
+    size_t len = ulog_binary_encode(record, sizeof(record), level, tag, format, args);
+    ULOG_STATS_INC(emitted[level]);
+    (*s_binary_output)(record, len);
+}
+
+void ulog_write_binary(ulog_level_t level, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    ulog_writev_binary(level, tag, format, list);
+    va_end(list);
+}
+
+void ulog_write_binary_unchecked(ulog_level_t level, const char *tag, const char *format, ...)
+{
+    uint8_t record[CONFIG_LOG_BINARY_RECORD_MAX];
+    va_list list;
+    va_start(list, format);
+    size_t len = ulog_binary_encode(record, sizeof(record), level, tag, format, list);
+    va_end(list);
+    ULOG_STATS_INC(emitted[level]);
+    (*s_binary_output)(record, len);
+}
+
+bool ulog_binary_decode(const void *data, size_t len, ulog_binary_record_t *record)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    uint16_t record_len;
+    if (len < 8 || p[0] != ULOG_BINARY_SYNC) {
+        return false;
+    }
+    memcpy(&record_len, p + 2, sizeof(record_len));
+    if (record_len > len) {
+        return false;
+    }
+    const uint8_t *end = p + record_len;
+    uint8_t flags = p[1];
+    record->level = (ulog_level_t) (flags & ULOG_BINARY_LEVEL_MASK);
+    record->truncated = (flags & ULOG_BINARY_TRUNCATED) != 0;
+    memcpy(&record->timestamp, p + 4, sizeof(record->timestamp));
+    p += 8;
+
+    if (flags & ULOG_BINARY_FMT_INLINE) {
+        record->format = (const char *) p;
+        p = memchr(p, '\0', end - p);
+        if (p == NULL) {
+            return false;
+        }
+        ++p;
+    } else {
+        uint32_t fmt_offset;
+        if (end - p < (ptrdiff_t) sizeof(fmt_offset)) {
+            return false;
+        }
+        memcpy(&fmt_offset, p, sizeof(fmt_offset));
+        if (fmt_offset >= (uintptr_t) __stop_ulog_fmt - (uintptr_t) __start_ulog_fmt) {
+            return false;
+        }
+        record->format = __start_ulog_fmt + fmt_offset;
+        p += sizeof(fmt_offset);
+    }
+
+    if (flags & ULOG_BINARY_TAG_INLINE) {
+        record->tag = (const char *) p;
+        p = memchr(p, '\0', end - p);
+        if (p == NULL) {
+            return false;
+        }
+        ++p;
+    } else {
+        uint16_t tag_id;
+        if (end - p < (ptrdiff_t) sizeof(tag_id)) {
+            return false;
+        }
+        memcpy(&tag_id, p, sizeof(tag_id));
+        if (tag_id >= __stop_ulog_tags - __start_ulog_tags) {
+            return false;
+        }
+        record->tag = __start_ulog_tags[tag_id].name;
+        p += sizeof(tag_id);
+    }
+    record->args = p;
+    record->end = end;
+    return true;
+}
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} record_reader_t;
+
+static inline bool get(record_reader_t *r, void *data, size_t len)
+{
+    if ((size_t) (r->end - r->p) < len) {
+        return false;
+    }
+    memcpy(data, r->p, len);
+    r->p += len;
+    return true;
+}
+
+static inline const char *get_str(record_reader_t *r)
+{
+    const uint8_t *nul = memchr(r->p, '\0', r->end - r->p);
+    if (nul == NULL) {
+        return NULL;
+    }
+    const char *str = (const char *) r->p;
+    r->p = nul + 1;
+    return str;
+}
+
+// snprintf with the '*' width and precision of the conversion, if any
+#define FORMAT_VALUE(value) \
+    (spec.width_arg && spec.precision_arg ? snprintf(out, room, conversion, width, precision, value) : \
+     spec.width_arg ? snprintf(out, room, conversion, width, value) : \
+     spec.precision_arg ? snprintf(out, room, conversion, precision, value) : \
+     snprintf(out, room, conversion, value))
+
+size_t ulog_binary_format(char *buf, size_t size, const ulog_binary_record_t *record)
+{
+    if (size == 0) {
+        return 0;
+    }
+    record_reader_t r = {
+        .p = record->args,
+        .end = record->end,
+    };
+    const char *format = record->format;
+    size_t len = 0;
+    ulog_fmt_spec_t spec;
+    while (len < size - 1) {
+        const char *literal = format;
+        bool more = ulog_fmt_next(&format, &spec);
+        size_t literal_len = (more ? spec.start : format) - literal;
+        if (literal_len > size - 1 - len) {
+            literal_len = size - 1 - len;
+        }
+        memcpy(buf + len, literal, literal_len);
+        len += literal_len;
+        if (!more || len >= size - 1) {
+            break;
+        }
+
+        int width = 0;
+        int precision = spec.precision;
+        if ((spec.width_arg && !get(&r, &width, sizeof(width))) ||
+                (spec.precision_arg && !get(&r, &precision, sizeof(precision)))) {
+            break;
+        }
+        char conversion[32];
+        size_t conversion_len = spec.end - spec.start;
+        if (conversion_len >= sizeof(conversion)) {
+            break;
+        }
+        memcpy(conversion, spec.start, conversion_len);
+        conversion[conversion_len] = '\0';
+
+        char *out = buf + len;
+        size_t room = size - len;
+        int ret = 0;
+        switch (spec.type) {
+        case ULOG_ARG_NONE:
+            buf[len] = '%';
+            ret = 1;
+            break;
+        case ULOG_ARG_INT: {
+            int value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_LONG: {
+            long value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_LLONG: {
+            long long value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_INTMAX: {
+            intmax_t value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_SIZE: {
+            size_t value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_PTRDIFF: {
+            ptrdiff_t value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_PTR: {
+            void *value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            if (spec.conversion != 'n') {
+                ret = FORMAT_VALUE(value);
+            }
+            break;
+        }
+        case ULOG_ARG_DOUBLE: {
+            double value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        case ULOG_ARG_LDOUBLE: {
+            double value;
+            if (!get(&r, &value, sizeof(value))) {
+                goto done;
+            }
+            ret = FORMAT_VALUE((long double) value);
+            break;
+        }
+        case ULOG_ARG_STR: {
+            const char *value = get_str(&r);
+            if (value == NULL) {
+                goto done;
+            }
+            ret = FORMAT_VALUE(value);
+            break;
+        }
+        }
+        if (ret > 0) {
+            len += (size_t) ret < room ? (size_t) ret : room - 1;
+        }
+    }
+done:
+    buf[len] = '\0';
+    return len;
+}
@@ -1,9 +1,16 @@
 #include <stdio.h>
-#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "ulog.h"
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 static inline bool uptr_byte_accessible(const void* ptr) {
     (void) ptr;
     return true;
@@ -12,15 +19,100 @@ static inline bool uptr_byte_accessible(const void* ptr) {
 //print number of bytes per line for ulog_buffer_char and ulog_buffer_hex
 #define BYTES_PER_LINE 16
 
-void ulog_buffer_hex_internal(const char *tag, const void *buffer, uint16_t buff_len,
+//format: field[length]
+// ADDR[18]+"   "+DATA_HEX[8*3-1]+"  "+DATA_HEX[8*3-1]+"  |"+DATA_CHAR[16]+"|"
+#define HEXDUMP_LINE_MAX (2 + 2 * sizeof(void *) + 3 + BYTES_PER_LINE * 3 + 3 + BYTES_PER_LINE + 1)
+
+static const char s_hex_digits[16] = "0123456789abcdef";
+
+/* Write the two hex digits of every byte of in to out, without separators */
+static void hex_encode(char *out, const uint8_t *in, size_t len)
+{
+#if defined(__SSSE3__)
+    const __m128i lut = _mm_loadu_si128((const __m128i *) s_hex_digits);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    for (; len >= 16; len -= 16, in += 16, out += 32) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) in);
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(bytes, nibble));
+        _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t lut = vld1q_u8((const uint8_t *) s_hex_digits);
+    for (; len >= 16; len -= 16, in += 16, out += 32) {
+        uint8x16_t bytes = vld1q_u8(in);
+        uint8x16x2_t digits;
+        digits.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(bytes, 4));
+        digits.val[1] = vqtbl1q_u8(lut, vandq_u8(bytes, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t *) out, digits);
+    }
+#endif
+    for (; len > 0; --len, ++in) {
+        *out++ = s_hex_digits[*in >> 4];
+        *out++ = s_hex_digits[*in & 0x0f];
+    }
+}
+
+/* Same as "%p" */
+static char *format_address(char *p, const void *addr)
+{
+    if (addr == NULL) {
+        memcpy(p, "(nil)", 5);
+        return p + 5;
+    }
+    uintptr_t value = (uintptr_t) addr;
+    int digits = 1;
+    while (digits < (int) (2 * sizeof(value)) && (value >> (4 * digits)) != 0) {
+        ++digits;
+    }
+    *p++ = '0';
+    *p++ = 'x';
+    for (int shift = 4 * (digits - 1); shift >= 0; shift -= 4) {
+        *p++ = s_hex_digits[(value >> shift) & 0x0f];
+    }
+    return p;
+}
+
+/* One line of ulog_buffer_hexdump_internal(), not terminated */
+static char *format_hexdump_line(char *p, const void *addr, const uint8_t *line, int bytes_cur_line)
+{
+    char hex[2 * BYTES_PER_LINE];
+    hex_encode(hex, line, bytes_cur_line);
+
+    p = format_address(p, addr);
+    *p++ = ' ';
+    for (int i = 0; i < BYTES_PER_LINE; i ++) {
+        if ((i & 7) == 0) {
+            *p++ = ' ';
+        }
+        *p++ = ' ';
+        if (i < bytes_cur_line) {
+            memcpy(p, hex + 2 * i, 2);
+        } else {
+            memset(p, ' ', 2);
+        }
+        p += 2;
+    }
+    memcpy(p, "  |", 3);
+    p += 3;
+    for (int i = 0; i < bytes_cur_line; i ++) {
+        *p++ = (line[i] >= 0x20 && line[i] < 0x7f) ? (char) line[i] : '.';
+    }
+    *p++ = '|';
+    return p;
+}
+
+void ulog_buffer_hex_internal(const char *tag, const void *buffer, size_t buff_len,
                                  ulog_level_t log_level)
 {
-    if (buff_len == 0) {
+    if (buff_len == 0 || !ulog_enabled(tag, log_level)) {
         return;
     }
     char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
     char hex_buffer[3 * BYTES_PER_LINE + 1];
-    const char *ptr_line;
+    char hex[2 * BYTES_PER_LINE];
+    const uint8_t *ptr_line;
     int bytes_cur_line;
 
     do {
@@ -32,24 +124,27 @@ void ulog_buffer_hex_internal(const char *tag, const void *buffer, uint16_t buff
         if (!uptr_byte_accessible(buffer)) {
             //use memcpy to get around alignment issue
             memcpy(temp_buffer, buffer, (bytes_cur_line + 3) / 4 * 4);
-            ptr_line = temp_buffer;
+            ptr_line = (const uint8_t *) temp_buffer;
         } else {
             ptr_line = buffer;
         }
 
+        hex_encode(hex, ptr_line, bytes_cur_line);
         for (int i = 0; i < bytes_cur_line; i ++) {
-            sprintf(hex_buffer + 3 * i, "%02x ", ptr_line[i]);
+            memcpy(hex_buffer + 3 * i, hex + 2 * i, 2);
+            hex_buffer[3 * i + 2] = ' ';
         }
+        hex_buffer[3 * bytes_cur_line] = '\0';
         ULOG_LEVEL(log_level, tag, "%s", hex_buffer);
         buffer += bytes_cur_line;
         buff_len -= bytes_cur_line;
     } while (buff_len);
 }
 
-void ulog_buffer_char_internal(const char *tag, const void *buffer, uint16_t buff_len,
+void ulog_buffer_char_internal(const char *tag, const void *buffer, size_t buff_len,
                                   ulog_level_t log_level)
 {
-    if (buff_len == 0) {
+    if (buff_len == 0 || !ulog_enabled(tag, log_level)) {
         return;
     }
     char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
@@ -71,27 +166,23 @@ void ulog_buffer_char_internal(const char *tag, const void *buffer, uint16_t buf
             ptr_line = buffer;
         }
 
-        for (int i = 0; i < bytes_cur_line; i ++) {
-            sprintf(char_buffer + i, "%c", ptr_line[i]);
-        }
+        memcpy(char_buffer, ptr_line, bytes_cur_line);
+        char_buffer[bytes_cur_line] = '\0';
         ULOG_LEVEL(log_level, tag, "%s", char_buffer);
         buffer += bytes_cur_line;
         buff_len -= bytes_cur_line;
     } while (buff_len);
 }
 
-void ulog_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t buff_len, ulog_level_t log_level)
+void ulog_buffer_hexdump_internal(const char *tag, const void *buffer, size_t buff_len, ulog_level_t log_level)
 {
 
-    if (buff_len == 0) {
+    if (buff_len == 0 || !ulog_enabled(tag, log_level)) {
         return;
     }
     char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
-    const char *ptr_line;
-    //format: field[length]
-    // ADDR[10]+"   "+DATA_HEX[8*3]+" "+DATA_HEX[8*3]+"  |"+DATA_CHAR[8]+"|"
-    char hd_buffer[10 + 3 + BYTES_PER_LINE * 3 + 3 + BYTES_PER_LINE + 1 + 1];
-    char *ptr_hd;
+    const uint8_t *ptr_line;
+    char hd_buffer[HEXDUMP_LINE_MAX + 1];
     int bytes_cur_line;
 
     do {
@@ -103,35 +194,57 @@ void ulog_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t
         if (!uptr_byte_accessible(buffer)) {
             //use memcpy to get around alignment issue
             memcpy(temp_buffer, buffer, (bytes_cur_line + 3) / 4 * 4);
-            ptr_line = temp_buffer;
+            ptr_line = (const uint8_t *) temp_buffer;
         } else {
             ptr_line = buffer;
         }
-        ptr_hd = hd_buffer;
-
-        ptr_hd += sprintf(ptr_hd, "%p ", buffer);
-        for (int i = 0; i < BYTES_PER_LINE; i ++) {
-            if ((i & 7) == 0) {
-                ptr_hd += sprintf(ptr_hd, " ");
-            }
-            if (i < bytes_cur_line) {
-                ptr_hd += sprintf(ptr_hd, " %02x", ptr_line[i]);
-            } else {
-                ptr_hd += sprintf(ptr_hd, "   ");
-            }
-        }
-        ptr_hd += sprintf(ptr_hd, "  |");
-        for (int i = 0; i < bytes_cur_line; i ++) {
-            if (isprint((int)ptr_line[i])) {
-                ptr_hd += sprintf(ptr_hd, "%c", ptr_line[i]);
-            } else {
-                ptr_hd += sprintf(ptr_hd, ".");
-            }
-        }
-        ptr_hd += sprintf(ptr_hd, "|");
 
+        *format_hexdump_line(hd_buffer, buffer, ptr_line, bytes_cur_line) = '\0';
         ULOG_LEVEL(log_level, tag, "%s", hd_buffer);
         buffer += bytes_cur_line;
         buff_len -= bytes_cur_line;
     } while (buff_len);
 }
+
+void ulog_buffer_hexdump_block_internal(const char *tag, const void *buffer, size_t buff_len, ulog_level_t log_level)
+{
+    if (buff_len == 0 || !ulog_enabled(tag, log_level)) {
+        return;
+    }
+    size_t lines = (buff_len + BYTES_PER_LINE - 1) / BYTES_PER_LINE;
+    // every line is preceded by a newline, plus the terminating null
+    char *text = (char *) malloc(lines * (HEXDUMP_LINE_MAX + 1) + 1);
+    if (text == NULL) {
+        ulog_buffer_hexdump_internal(tag, buffer, buff_len, log_level);
+        return;
+    }
+    char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
+    const uint8_t *ptr_line;
+    char *ptr_hd = text;
+    size_t remaining = buff_len;
+    int bytes_cur_line;
+
+    do {
+        if (remaining > BYTES_PER_LINE) {
+            bytes_cur_line = BYTES_PER_LINE;
+        } else {
+            bytes_cur_line = remaining;
+        }
+        if (!uptr_byte_accessible(buffer)) {
+            //use memcpy to get around alignment issue
+            memcpy(temp_buffer, buffer, (bytes_cur_line + 3) / 4 * 4);
+            ptr_line = (const uint8_t *) temp_buffer;
+        } else {
+            ptr_line = buffer;
+        }
+
+        *ptr_hd++ = '\n';
+        ptr_hd = format_hexdump_line(ptr_hd, buffer, ptr_line, bytes_cur_line);
+        buffer += bytes_cur_line;
+        remaining -= bytes_cur_line;
+    } while (remaining);
+    *ptr_hd = '\0';
+
+    ULOG_LEVEL(log_level, tag, "%u bytes:%s", (unsigned) buff_len, text);
+    free(text);
+}
@@ -9,6 +9,98 @@
 
 #define CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM      1
 
+#define CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION   3
+
+#define CONFIG_LOG_SYSTEM_TIMESTAMP_COARSE      0
+
 #define CONFIG_LOG_MAXIMUM_LEVEL            5
 
+#define CONFIG_LOG_TAG_TABLE_SIZE               1024
+
+#define CONFIG_LOG_TAG_POOL_SIZE                8192
+
+#define CONFIG_LOG_LEVEL_RULE_NODES             256
+
+#define CONFIG_LOG_FILTER                       1
+
+#define CONFIG_LOG_FILTER_MAX                   8
+
+#define CONFIG_LOG_FILTER_PATTERN_MAX           32
+
+#define CONFIG_LOG_FILTER_CACHE_SIZE            64
+
+#define CONFIG_LOG_ASYNC                        1
+
+#define CONFIG_LOG_ASYNC_RING_SIZE              4096
+
+#define CONFIG_LOG_ASYNC_BLOCK_WHEN_FULL        0
+
+#define CONFIG_LOG_ASYNC_FLUSH_PERIOD_MS        10
+
+#define CONFIG_LOG_ASYNC_TASK_STACK_SIZE        3072
+
+#define CONFIG_LOG_ASYNC_TASK_PRIORITY          1
+
+#define CONFIG_LOG_THREAD_LOCAL_STORAGE_INDEX   1
+
+#define CONFIG_LOG_ISR                          1
+
+#define CONFIG_LOG_ISR_RING_SIZE                2048
+
+#define CONFIG_LOG_ISR_RECORD_MAX               128
+
+#define CONFIG_LOG_BINARY                       0
+
+#define CONFIG_LOG_BINARY_RECORD_MAX            256
+
+#define CONFIG_LOG_BINARY_STRING_MAX            64
+
+#define CONFIG_LOG_KV_RECORD_MAX                256
+
+#define CONFIG_LOG_BACKTRACE                    1
+
+#define CONFIG_LOG_BACKTRACE_LEVEL              ULOG_DEBUG
+
+#define CONFIG_LOG_BACKTRACE_SLOTS              256
+
+#define CONFIG_LOG_BACKTRACE_SLOT_SIZE          128
+
+#define CONFIG_LOG_LAZY_FORMAT                  1
+
+#define CONFIG_LOG_VSNPRINTF                    1
+
+#define CONFIG_LOG_SITES                        0
+
+#define CONFIG_LOG_RATE_LIMIT                   0
+
+#define CONFIG_LOG_RATE_LIMIT_BURST             20
+
+#define CONFIG_LOG_RATE_LIMIT_PER_SEC           10
+
+#define CONFIG_LOG_RATE_LIMIT_PENDING           16
+
+#define CONFIG_LOG_SINK_MAX                     8
+
+#define CONFIG_LOG_LINE_BUFFER_SIZE             512
+
+#define CONFIG_LOG_STATS_SHARDS                 4
+
+#define CONFIG_LOG_PROFILE                      0
+
+#define CONFIG_LOG_PROFILE_TAGS                 64
+
+#define CONFIG_LOG_FD_SINK_BUFFER_SIZE          65536
+
+#define CONFIG_LOG_FD_SINK_FLUSH_PERIOD_MS      100
+
+#define CONFIG_LOG_MMAP_SINK_SEGMENT_SIZE       4194304
+
+#define CONFIG_LOG_MMAP_SINK_SEGMENT_COUNT      4
+
+#define CONFIG_LOG_FLASH_SINK_BLOCK_SIZE        4000
+
+#define CONFIG_LOG_FLASH_SINK_FLUSH_PERIOD_MS   60000
+
+#define CONFIG_LOG_FLASH_SINK_HASH_BITS         10
+
 #endif
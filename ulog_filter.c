@@ -0,0 +1,274 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_FILTER
+
+_Static_assert((CONFIG_LOG_FILTER_CACHE_SIZE & (CONFIG_LOG_FILTER_CACHE_SIZE - 1)) == 0,
+               "CONFIG_LOG_FILTER_CACHE_SIZE must be a power of 2");
+
+/* Filters are written under ulog_impl_lock() and read without it, like the tag
+   filters of the sinks: an entry logged during a change may see either set.
+*/
+typedef struct {
+    char pattern[CONFIG_LOG_FILTER_PATTERN_MAX];
+    uint8_t mode;
+} filter_t;
+
+static filter_t s_filters[CONFIG_LOG_FILTER_MAX];
+static atomic_uint s_filter_count;
+
+/* Verdicts are cached per format pointer, direct-mapped, every slot protected by
+   its own sequence counter like the tag cache. A slot holds the generation of the
+   filters it was computed with in the upper bits of its verdict.
+*/
+typedef struct {
+    atomic_uint seq;
+    _Atomic(const char *) format;
+    atomic_uint verdict;
+} verdict_slot_t;
+
+static verdict_slot_t s_verdicts[CONFIG_LOG_FILTER_CACHE_SIZE];
+static atomic_uint s_generation;
+
+#define VERDICT_BITS    2
+#define VERDICT_MASK    ((1u << VERDICT_BITS) - 1)
+
+/* Result of the search of a pattern in the literal text of a format */
+typedef enum {
+    FOUND,
+    NOT_FOUND,      // and the format has no argument, so neither has the message
+    UNKNOWN,        // depends on the arguments
+} search_t;
+
+/* Next character of the literal text of a format, "%%" being one '%' */
+static inline char literal_char(const char **p)
+{
+    char c = *(*p)++;
+    if (c == '%' && **p == '%') {
+        ++*p;
+    }
+    return c;
+}
+
+/* Does pattern match the start of [text, end)? In the literal text of a format when
+   format is true, where "%%" reads as '%'. The rest of the text is not matched. */
+static bool match_here(const char *text, const char *end, const char *pattern, bool format)
+{
+    const char *star_pattern = NULL;
+    const char *star_text = NULL;
+    while (*pattern) {
+        if (*pattern == '*') {
+            star_pattern = ++pattern;
+            star_text = text;
+            continue;
+        }
+        if (text < end) {
+            const char *next = text;
+            char c = format ? literal_char(&next) : *next++;
+            if (*pattern == '?' || *pattern == c) {
+                ++pattern;
+                text = next;
+                continue;
+            }
+        }
+        if (star_pattern == NULL || star_text >= end) {
+            return false;
+        }
+        // let the last '*' take one more character
+        if (format) {
+            literal_char(&star_text);
+        } else {
+            ++star_text;
+        }
+        pattern = star_pattern;
+        text = star_text;
+    }
+    return true;
+}
+
+static bool search(const char *text, const char *end, const char *pattern, bool format)
+{
+    for (const char *p = text; p <= end; ) {
+        if (match_here(p, end, pattern, format)) {
+            return true;
+        }
+        if (p == end) {
+            break;
+        }
+        if (format) {
+            literal_char(&p);
+        } else {
+            ++p;
+        }
+    }
+    return false;
+}
+
+/* Message part of a format, after the "tag: " prefix of LOG_FORMAT() and alike */
+static const char *message_format(const char *format)
+{
+    const char *prefix = strstr(format, ") %s: ");
+    return prefix ? prefix + 6 : format;
+}
+
+/* End of the message in [text, end), before the line end and color reset */
+static const char *message_end(const char *text, const char *end)
+{
+    static const char suffix[] = LOG_RESET_COLOR "\n";
+    size_t len = sizeof(suffix) - 1;
+    if ((size_t) (end - text) >= len && memcmp(end - len, suffix, len) == 0) {
+        return end - len;
+    }
+    if (end > text && end[-1] == '\n') {
+        return end - 1;
+    }
+    return end;
+}
+
+/* Search the pattern in the literal runs of the format, between its conversions */
+static search_t search_format(const char *format, const char *end, const char *pattern)
+{
+    bool has_args = false;
+    const char *run = format;
+    ulog_fmt_spec_t spec;
+    while (ulog_fmt_next(&format, &spec)) {
+        if (spec.type == ULOG_ARG_NONE) {
+            continue;   // "%%" is part of the run
+        }
+        if (search(run, spec.start, pattern, true)) {
+            return FOUND;
+        }
+        has_args = true;
+        run = spec.end;
+    }
+    if (run < end && search(run, end, pattern, true)) {
+        return FOUND;
+    }
+    return has_args ? UNKNOWN : NOT_FOUND;
+}
+
+static ulog_filter_verdict_t compute_verdict(const char *format, unsigned count)
+{
+    format = message_format(format);
+    const char *end = message_end(format, format + strlen(format));
+    bool include = false;       // there are include filters
+    bool included = false;      // one of them is found
+    bool unknown = false;
+    for (unsigned i = 0; i < count; ++i) {
+        const filter_t *filter = &s_filters[i];
+        search_t found = search_format(format, end, filter->pattern);
+        if (filter->mode == ULOG_FILTER_EXCLUDE) {
+            if (found == FOUND) {
+                return ULOG_FILTER_DROP;
+            }
+            unknown |= found == UNKNOWN;
+        } else {
+            include = true;
+            included |= found == FOUND;
+            unknown |= found == UNKNOWN;
+        }
+    }
+    if (include && !included && !unknown) {
+        return ULOG_FILTER_DROP;
+    }
+    // an exclude filter may still drop an included entry
+    return unknown ? ULOG_FILTER_TEXT : ULOG_FILTER_PASS;
+}
+
+static inline verdict_slot_t *verdict_slot_for(const char *format)
+{
+    uint32_t hash = (uint32_t) ((uintptr_t) format ^ ((uintptr_t) format >> 16)) * 2654435769u;
+    return &s_verdicts[hash >> (32 - __builtin_ctz(CONFIG_LOG_FILTER_CACHE_SIZE))];
+}
+
+ulog_filter_verdict_t ulog_filter_format(const char *format)
+{
+    unsigned count = atomic_load_explicit(&s_filter_count, memory_order_acquire);
+    if (count == 0) {
+        return ULOG_FILTER_PASS;
+    }
+    uint32_t generation = atomic_load_explicit(&s_generation, memory_order_acquire);
+    verdict_slot_t *slot = verdict_slot_for(format);
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (!(seq & 1)) {
+        const char *cached_format = atomic_load_explicit(&slot->format, memory_order_relaxed);
+        uint32_t verdict = atomic_load_explicit(&slot->verdict, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (cached_format == format && (verdict >> VERDICT_BITS) == (generation & (UINT32_MAX >> VERDICT_BITS)) &&
+                atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+            return (ulog_filter_verdict_t) (verdict & VERDICT_MASK);
+        }
+    }
+
+    ulog_filter_verdict_t verdict = compute_verdict(format, count);
+    // skip the update if another thread is writing the slot
+    if (!(seq & 1) && atomic_compare_exchange_strong_explicit(&slot->seq, &seq, seq + 1,
+                                                              memory_order_relaxed, memory_order_relaxed)) {
+        atomic_thread_fence(memory_order_release);
+        atomic_store_explicit(&slot->format, format, memory_order_relaxed);
+        atomic_store_explicit(&slot->verdict, generation << VERDICT_BITS | verdict, memory_order_relaxed);
+        atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    }
+    return verdict;
+}
+
+bool ulog_filter_text(const char *format, const char *text, size_t len)
+{
+    const char *end = message_end(text, text + len);
+    if (message_format(format) != format) {
+        // skip the prefix "X (timestamp) tag: "
+        const char *p = memchr(text, ')', len);
+        p = p ? memchr(p, ':', end - p) : NULL;
+        if (p != NULL && end - p >= 2) {
+            text = p + 2;
+        }
+    }
+    unsigned count = atomic_load_explicit(&s_filter_count, memory_order_acquire);
+    bool include = false;
+    bool included = false;
+    for (unsigned i = 0; i < count; ++i) {
+        const filter_t *filter = &s_filters[i];
+        bool found = search(text, end, filter->pattern, false);
+        if (filter->mode == ULOG_FILTER_EXCLUDE) {
+            if (found) {
+                return false;
+            }
+        } else {
+            include = true;
+            included |= found;
+        }
+    }
+    return !include || included;
+}
+
+bool ulog_filter_add(const char *pattern, ulog_filter_mode_t mode)
+{
+    ulog_impl_lock();
+    unsigned count = atomic_load_explicit(&s_filter_count, memory_order_relaxed);
+    if (count >= CONFIG_LOG_FILTER_MAX) {
+        ulog_impl_unlock();
+        return false;
+    }
+    filter_t *filter = &s_filters[count];
+    filter->pattern[0] = '\0';
+    strncat(filter->pattern, pattern, sizeof(filter->pattern) - 1);
+    filter->mode = (uint8_t) mode;
+    atomic_fetch_add_explicit(&s_generation, 1, memory_order_relaxed);
+    atomic_store_explicit(&s_filter_count, count + 1, memory_order_release);
+    ulog_impl_unlock();
+    return true;
+}
+
+void ulog_filter_clear(void)
+{
+    ulog_impl_lock();
+    atomic_store_explicit(&s_filter_count, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_generation, 1, memory_order_release);
+    ulog_impl_unlock();
+}
+
+#endif // CONFIG_LOG_FILTER
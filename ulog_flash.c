@@ -0,0 +1,739 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#define HASH_BITS       CONFIG_LOG_FLASH_SINK_HASH_BITS
+#define MIN_MATCH       4
+#define LAST_LITERALS   5       // LZ4 ends every block with literals
+#define MF_LIMIT        12      // and starts no match in its last 12 bytes
+
+#define ALIGN4(x)       (((x) + 3) & ~(size_t) 3)
+
+/* A block of entries in RAM */
+typedef struct {
+    char *text;
+    size_t len;
+    uint32_t first_ts;
+} ram_block_t;
+
+/* Writers fill one block while the other one, once sealed, waits for the poll
+   function. Only the poll function and the flush access the flash, with flash_lock:
+   the writers copy the entries and never wait for it.
+*/
+struct ulog_flash_sink {
+    ulog_flash_sink_config_t config;
+    atomic_flag lock;           // the blocks, taken by the writers for a copy
+    atomic_flag flash_lock;     // the flash state below
+    ram_block_t blocks[2];
+    unsigned fill;              // index of the block being filled
+    bool sealed;                // the other block waits for the flash
+    atomic_size_t dropped;
+    uint32_t offset;            // where the next block is programmed
+    uint32_t seq;               // sequence number of the next block
+    bool erased;                // the sector of offset is erased from offset on, offset starts a sector otherwise
+    uint8_t *payload;           // header and compressed entries of a block
+    uint16_t *table;            // hash table of the compressor
+};
+
+static inline void lock(atomic_flag *flag)
+{
+    while (atomic_flag_test_and_set_explicit(flag, memory_order_acquire)) {
+        ulog_impl_yield();
+    }
+}
+
+static inline void unlock(atomic_flag *flag)
+{
+    atomic_flag_clear_explicit(flag, memory_order_release);
+}
+
+/* CRC-32 (IEEE), chained by passing the previous value */
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0xf];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lz4_hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *put_length(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+/* Worst case size of a sequence with lit_len literals and a match of match_len bytes */
+static inline size_t sequence_size(size_t lit_len, size_t match_len)
+{
+    return 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len)
+{
+    uint8_t *token = op++;
+    *token = (uint8_t) ((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    return op + lit_len;
+}
+
+/* Compress src into dst in the LZ4 block format, greedy with a single hash table.
+   Returns the length of the result, 0 if it does not fit in capacity. */
+static size_t lz4_compress(uint16_t *table, const uint8_t *src, size_t len, uint8_t *dst, size_t capacity)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + capacity;
+
+    memset(table, 0, sizeof(uint16_t) << HASH_BITS);
+    if (len >= MF_LIMIT) {
+        const uint8_t *match_limit = end - MF_LIMIT;
+        const uint8_t *match_end = end - LAST_LITERALS;
+        while (ip <= match_limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t hash = lz4_hash(sequence);
+            const uint8_t *ref = src + table[hash];
+            table[hash] = (uint16_t) (ip - src);
+            if (ref >= ip || read32(ref) != sequence) {
+                ++ip;
+                continue;
+            }
+            const uint8_t *mp = ip + MIN_MATCH;
+            const uint8_t *rp = ref + MIN_MATCH;
+            while (mp < match_end && *mp == *rp) {
+                ++mp;
+                ++rp;
+            }
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            size_t lit_len = (size_t) (ip - anchor);
+            size_t match_len = (size_t) (mp - ip) - MIN_MATCH;
+            if (sequence_size(lit_len, match_len) > (size_t) (op_end - op)) {
+                return 0;
+            }
+            uint8_t *token = op;
+            op = put_sequence(op, anchor, lit_len);
+            size_t offset = (size_t) (ip - ref);
+            *op++ = (uint8_t) offset;
+            *op++ = (uint8_t) (offset >> 8);
+            *token |= (uint8_t) (match_len < 15 ? match_len : 15);
+            if (match_len >= 15) {
+                op = put_length(op, match_len - 15);
+            }
+            ip = mp;
+            anchor = ip;
+            if (ip <= match_limit) {
+                table[lz4_hash(read32(ip - 2))] = (uint16_t) (ip - 2 - src);
+            }
+        }
+    }
+    size_t lit_len = (size_t) (end - anchor);
+    if (sequence_size(lit_len, 0) > (size_t) (op_end - op)) {
+        return 0;
+    }
+    op = put_sequence(op, anchor, lit_len);
+    return (size_t) (op - dst);
+}
+
+static bool get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+    uint8_t byte;
+    do {
+        if (*ip == end) {
+            return false;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/* Decompress an LZ4 block, returns its length or 0 if it is invalid or exceeds capacity */
+static size_t lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + capacity;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !get_length(&ip, end, &lit_len)) {
+            return 0;
+        }
+        if (lit_len > (size_t) (end - ip) || lit_len > (size_t) (op_end - op)) {
+            return 0;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == end) {
+            break;      // the last sequence has no match
+        }
+        if (end - ip < 2) {
+            return 0;
+        }
+        size_t offset = ip[0] | (size_t) ip[1] << 8;
+        ip += 2;
+        size_t match_len = token & 0xf;
+        if (match_len == 15 && !get_length(&ip, end, &match_len)) {
+            return 0;
+        }
+        match_len += MIN_MATCH;
+        if (offset == 0 || offset > (size_t) (op - dst) || match_len > (size_t) (op_end - op)) {
+            return 0;
+        }
+        // the match may overlap the bytes it produces
+        const uint8_t *ref = op - offset;
+        while (match_len--) {
+            *op++ = *ref++;
+        }
+    }
+    return (size_t) (op - dst);
+}
+
+static inline uint32_t header_crc(const ulog_flash_header_t *header, const uint8_t *payload)
+{
+    uint32_t crc = crc32_update(0, header, offsetof(ulog_flash_header_t, crc));
+    return crc32_update(crc, payload, header->len);
+}
+
+static inline uint32_t sector_start(const ulog_flash_sink_t *sink, uint32_t offset)
+{
+    return offset - offset % sink->config.sector_size;
+}
+
+static inline uint32_t next_sector(const ulog_flash_sink_t *sink, uint32_t offset)
+{
+    uint32_t next = sector_start(sink, offset) + sink->config.sector_size;
+    return next == sink->config.partition_size ? 0 : next;
+}
+
+/* Read and check the header of the block at offset. Returns the offset of the next
+   block, 0 if there is no block at offset. */
+static uint32_t read_header(const ulog_flash_sink_t *sink, uint32_t offset, ulog_flash_header_t *header)
+{
+    uint32_t room = sink->config.sector_size - offset % sink->config.sector_size;
+    if (room < sizeof(*header) || !sink->config.read(sink->config.ctx, offset, header, sizeof(*header))) {
+        return 0;
+    }
+    if (header->magic != ULOG_FLASH_MAGIC || header->len == 0 || header->len > header->text_len ||
+        header->len > sink->config.block_size || sizeof(*header) + header->len > room) {
+        return 0;
+    }
+    return offset + ALIGN4(sizeof(*header) + header->len);
+}
+
+/* Read the payload of the block at offset into payload (block_size bytes) and check its CRC */
+static bool read_payload(const ulog_flash_sink_t *sink, uint32_t offset, const ulog_flash_header_t *header,
+                         uint8_t *payload)
+{
+    return sink->config.read(sink->config.ctx, offset + sizeof(*header), payload, header->len) &&
+           header_crc(header, payload) == header->crc;
+}
+
+static uint32_t read_block(const ulog_flash_sink_t *sink, uint32_t offset, ulog_flash_header_t *header,
+                           uint8_t *payload)
+{
+    uint32_t next = read_header(sink, offset, header);
+    return next != 0 && read_payload(sink, offset, header, payload) ? next : 0;
+}
+
+static bool is_erased(const ulog_flash_sink_t *sink, uint32_t offset, uint32_t end)
+{
+    uint8_t buf[64];
+    while (offset < end) {
+        size_t len = end - offset < sizeof(buf) ? end - offset : sizeof(buf);
+        if (!sink->config.read(sink->config.ctx, offset, buf, len)) {
+            return false;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            if (buf[i] != 0xff) {
+                return false;
+            }
+        }
+        offset += len;
+    }
+    return true;
+}
+
+/* Find where the previous runs stopped: after the last block of the sector starting
+   with the highest sequence number */
+static void resume(ulog_flash_sink_t *sink)
+{
+    const uint32_t sector_size = sink->config.sector_size;
+    ulog_flash_header_t header;
+    bool found = false;
+    uint32_t last = 0;
+    for (uint32_t offset = 0; offset < sink->config.partition_size; offset += sector_size) {
+        if (read_block(sink, offset, &header, sink->payload) &&
+            (!found || (int32_t) (header.seq - sink->seq) > 0)) {
+            found = true;
+            last = offset;
+            sink->seq = header.seq;
+        }
+    }
+    sink->offset = 0;
+    sink->erased = false;
+    if (!found) {
+        return;
+    }
+    uint32_t offset = last;
+    uint32_t next;
+    while ((next = read_block(sink, offset, &header, sink->payload)) != 0 && header.seq == sink->seq) {
+        sink->seq++;
+        offset = next;
+        if (offset % sector_size == 0) {
+            break;
+        }
+    }
+    uint32_t end = sector_start(sink, last) + sector_size;
+    if (offset < end && is_erased(sink, offset, end)) {
+        sink->offset = offset;
+        sink->erased = true;
+    } else {
+        sink->offset = next_sector(sink, last);
+    }
+}
+
+/* Make room for size bytes at offset, erasing the next sector if needed */
+static bool reserve(ulog_flash_sink_t *sink, size_t size)
+{
+    const uint32_t sector_size = sink->config.sector_size;
+    if (sink->erased && sector_size - sink->offset % sector_size < size) {
+        sink->offset = next_sector(sink, sink->offset);
+        sink->erased = false;
+    }
+    if (!sink->erased) {
+        if (!sink->config.erase(sink->config.ctx, sink->offset, sector_size)) {
+            return false;
+        }
+        sink->erased = true;
+    }
+    return true;
+}
+
+static inline void bloom_add(uint32_t *bloom, uint32_t hash)
+{
+    bloom[(hash >> 5) & 3] |= 1u << (hash & 31);
+    bloom[(hash >> 12) & 3] |= 1u << ((hash >> 7) & 31);
+}
+
+static inline bool bloom_test(const uint32_t *bloom, uint32_t hash)
+{
+    return (bloom[(hash >> 5) & 3] & (1u << (hash & 31))) &&
+           (bloom[(hash >> 12) & 3] & (1u << ((hash >> 7) & 31)));
+}
+
+/* Fill the index of the header from the prefixes of the entries */
+static void index_block(ulog_flash_header_t *header, const ram_block_t *block)
+{
+    const char *p = block->text;
+    const char *end = block->text + block->len;
+    bool has_time = false;
+    bool any_time = false;
+    bool in_entry = false;
+    header->levels = 0;
+    memset(header->reserved, 0, sizeof(header->reserved));
+    memset(header->tags, 0, sizeof(header->tags));
+    while (p < end) {
+        const char *line_end = memchr(p, '\n', (size_t) (end - p));
+        line_end = line_end ? line_end + 1 : end;
+        ulog_entry_prefix_t prefix;
+        if (ulog_entry_parse(p, (size_t) (line_end - p), &prefix)) {
+            in_entry = true;
+            header->levels |= (uint8_t) (1u << prefix.level);
+            bloom_add(header->tags, ulog_tag_hash_n(prefix.tag, prefix.tag_len));
+            if (!prefix.has_timestamp) {
+                any_time = true;
+            } else if (!has_time) {
+                has_time = true;
+                header->first_ts = header->last_ts = prefix.timestamp;
+            } else if (prefix.timestamp < header->first_ts) {
+                header->first_ts = prefix.timestamp;    // entries of the interrupt handlers come late
+            } else if (prefix.timestamp > header->last_ts) {
+                header->last_ts = prefix.timestamp;
+            }
+        } else if (!in_entry) {
+            // leading lines without a prefix, of any level and time
+            in_entry = true;
+            header->levels = 0xff;
+            any_time = true;
+        }
+        p = line_end;
+    }
+    if (any_time) {
+        header->first_ts = 0;
+        header->last_ts = UINT32_MAX;
+    } else if (!has_time) {
+        header->first_ts = header->last_ts = block->first_ts;
+    }
+}
+
+/* Compress a sealed block and append it to the partition, with flash_lock */
+static void store_block(ulog_flash_sink_t *sink, const ram_block_t *block)
+{
+    ulog_flash_header_t *header = (ulog_flash_header_t *) sink->payload;
+    uint8_t *data = sink->payload + sizeof(*header);
+    size_t len = lz4_compress(sink->table, (const uint8_t *) block->text, block->len, data, block->len - 1);
+    if (len == 0) {
+        // stored as is, the compressed version would not be shorter
+        memcpy(data, block->text, block->len);
+        len = block->len;
+    }
+    size_t size = ALIGN4(sizeof(*header) + len);
+    memset(data + len, 0xff, size - sizeof(*header) - len);
+
+    header->magic = ULOG_FLASH_MAGIC;
+    header->seq = sink->seq;
+    index_block(header, block);
+    header->text_len = (uint16_t) block->len;
+    header->len = (uint16_t) len;
+    header->crc = header_crc(header, data);
+
+    if (!reserve(sink, size) || !sink->config.program(sink->config.ctx, sink->offset, sink->payload, size)) {
+        // the sector may be partly programmed, start again from the next one
+        atomic_fetch_add_explicit(&sink->dropped, block->len, memory_order_relaxed);
+        sink->offset = next_sector(sink, sink->offset);
+        sink->erased = false;
+        return;
+    }
+    sink->seq++;
+    sink->offset += size;
+    if (sink->offset % sink->config.sector_size == 0) {
+        sink->offset = sink->offset == sink->config.partition_size ? 0 : sink->offset;
+        sink->erased = false;
+    }
+}
+
+/* With lock, the writers move to the other block */
+static inline void seal(ulog_flash_sink_t *sink)
+{
+    sink->sealed = true;
+    sink->fill ^= 1;
+    sink->blocks[sink->fill].len = 0;
+}
+
+/* Seal the block being filled if forced or if its first entry is due, returns the
+   sealed block if there is one */
+static ram_block_t *sealed_block(ulog_flash_sink_t *sink, bool force)
+{
+    lock(&sink->lock);
+    ram_block_t *block = &sink->blocks[sink->fill];
+    if (!sink->sealed && block->len > 0) {
+        uint32_t period = sink->config.flush_period_ms;
+        if (force || (period != 0 && ulog_timestamp() - block->first_ts >= period)) {
+            seal(sink);
+        }
+    }
+    block = sink->sealed ? &sink->blocks[sink->fill ^ 1] : NULL;
+    unlock(&sink->lock);
+    return block;
+}
+
+static void release_block(ulog_flash_sink_t *sink)
+{
+    lock(&sink->lock);
+    sink->sealed = false;
+    unlock(&sink->lock);
+}
+
+ulog_flash_sink_t *ulog_flash_sink_create(const ulog_flash_sink_config_t *config)
+{
+    if (config->read == NULL || config->program == NULL || config->erase == NULL ||
+        config->sector_size == 0 || config->partition_size % config->sector_size != 0 ||
+        config->partition_size / config->sector_size < 2 || config->block_size == 0 ||
+        config->block_size > UINT16_MAX ||
+        ALIGN4(sizeof(ulog_flash_header_t) + config->block_size) > config->sector_size) {
+        return NULL;
+    }
+    ulog_flash_sink_t *sink = calloc(1, sizeof(ulog_flash_sink_t));
+    if (sink == NULL) {
+        return NULL;
+    }
+    // payload, hash table, then both blocks
+    size_t payload_size = ALIGN4(sizeof(ulog_flash_header_t) + config->block_size);
+    size_t table_size = sizeof(uint16_t) << HASH_BITS;
+    sink->payload = malloc(payload_size + table_size + 2 * config->block_size);
+    if (sink->payload == NULL) {
+        free(sink);
+        return NULL;
+    }
+    sink->table = (uint16_t *) (sink->payload + payload_size);
+    sink->blocks[0].text = (char *) sink->payload + payload_size + table_size;
+    sink->blocks[1].text = sink->blocks[0].text + config->block_size;
+    sink->config = *config;
+    atomic_flag_clear(&sink->lock);
+    atomic_flag_clear(&sink->flash_lock);
+    resume(sink);
+    return sink;
+}
+
+void ulog_flash_sink_destroy(ulog_flash_sink_t *sink)
+{
+    if (sink != NULL) {
+        free(sink->payload);
+        free(sink);
+    }
+}
+
+/* Length of the start of buf that fits in room bytes, whole entries if possible */
+static size_t fit_entries(const char *buf, size_t len, size_t room)
+{
+    if (len <= room) {
+        return len;
+    }
+    for (size_t i = room; i > 0; --i) {
+        if (buf[i - 1] == '\n') {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void ulog_flash_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    (void) level;
+    ulog_flash_sink_t *sink = (ulog_flash_sink_t *) ctx;
+    const size_t block_size = sink->config.block_size;
+    lock(&sink->lock);
+    while (len) {
+        ram_block_t *block = &sink->blocks[sink->fill];
+        size_t copied = fit_entries(buf, len, block_size - block->len);
+        if (copied == 0 && block->len == 0) {
+            copied = block_size;    // an entry longer than a block
+        }
+        if (copied) {
+            if (block->len == 0) {
+                block->first_ts = ulog_timestamp();
+            }
+            memcpy(block->text + block->len, buf, copied);
+            block->len += copied;
+            buf += copied;
+            len -= copied;
+            if (len == 0) {
+                break;
+            }
+        }
+        if (sink->sealed) {
+            // the poll function is late
+            atomic_fetch_add_explicit(&sink->dropped, len, memory_order_relaxed);
+            break;
+        }
+        seal(sink);
+    }
+    unlock(&sink->lock);
+}
+
+void ulog_flash_sink_poll(void *ctx)
+{
+    ulog_flash_sink_t *sink = (ulog_flash_sink_t *) ctx;
+    if (atomic_flag_test_and_set_explicit(&sink->flash_lock, memory_order_acquire)) {
+        return;     // flushed or read from another thread
+    }
+    const ram_block_t *block = sealed_block(sink, false);
+    if (block) {
+        store_block(sink, block);
+        release_block(sink);
+    }
+    unlock(&sink->flash_lock);
+}
+
+void ulog_flash_sink_flush(ulog_flash_sink_t *sink)
+{
+    lock(&sink->flash_lock);
+    const ram_block_t *block;
+    while ((block = sealed_block(sink, true)) != NULL) {
+        store_block(sink, block);
+        release_block(sink);
+    }
+    unlock(&sink->flash_lock);
+}
+
+/* Criteria of ulog_flash_sink_query() */
+typedef struct {
+    uint32_t from_ts;
+    uint32_t to_ts;
+    ulog_level_t level;
+    const char *tag;
+    size_t tag_len;
+    uint32_t tag_hash;
+    ulog_backtrace_cb_t cb;
+    void *arg;
+    size_t done;
+} query_t;
+
+static bool block_matches(const query_t *query, const ulog_flash_header_t *header)
+{
+    uint32_t levels = (1u << (query->level + 1)) - 2;   // ULOG_ERROR to level
+    return header->last_ts >= query->from_ts && header->first_ts <= query->to_ts && (header->levels & levels) &&
+           (query->tag == NULL || bloom_test(header->tags, query->tag_hash));
+}
+
+/* Call fn for the blocks of the partition, oldest first. Only the blocks matching
+   query are read and decompressed. */
+static bool walk_blocks(ulog_flash_sink_t *sink, const query_t *query,
+                        bool (*fn)(const ulog_flash_header_t *header, const char *text, size_t len, void *arg),
+                        void *arg)
+{
+    const uint32_t sector_size = sink->config.sector_size;
+    const size_t block_size = sink->config.block_size;
+    uint8_t *payload = malloc(2 * block_size);
+    if (payload == NULL) {
+        return false;
+    }
+    char *text = (char *) payload + block_size;
+    lock(&sink->flash_lock);
+    // the oldest blocks are in the sector after the one being filled
+    uint32_t first = sink->erased ? next_sector(sink, sink->offset) : sink->offset;
+    uint32_t sector = first;
+    do {
+        ulog_flash_header_t header;
+        uint32_t offset = sector;
+        uint32_t next;
+        while ((next = read_header(sink, offset, &header)) != 0) {
+            if (query == NULL || block_matches(query, &header)) {
+                if (!read_payload(sink, offset, &header, payload)) {
+                    break;
+                }
+                size_t len = header.len;
+                if (header.len == header.text_len) {
+                    memcpy(text, payload, len);
+                } else {
+                    len = lz4_decompress(payload, header.len, (uint8_t *) text, block_size);
+                }
+                if (len == header.text_len && !fn(&header, text, len, arg)) {
+                    goto done;
+                }
+            }
+            offset = next;
+            if (offset % sector_size == 0) {
+                break;
+            }
+        }
+        sector = next_sector(sink, sector);
+    } while (sector != first);
+done:
+    unlock(&sink->flash_lock);
+    free(payload);
+    return true;
+}
+
+bool ulog_flash_sink_foreach(ulog_flash_sink_t *sink,
+                             bool (*fn)(const ulog_flash_header_t *header, const char *text, size_t len, void *arg),
+                             void *arg)
+{
+    return walk_blocks(sink, NULL, fn, arg);
+}
+
+static bool entry_matches(const query_t *query, const ulog_entry_prefix_t *prefix)
+{
+    if (prefix->tag == NULL) {
+        return query->tag == NULL;  // without a prefix
+    }
+    if (prefix->level > query->level ||
+        (prefix->has_timestamp && (prefix->timestamp < query->from_ts || prefix->timestamp > query->to_ts))) {
+        return false;
+    }
+    return query->tag == NULL ||
+           (prefix->tag_len == query->tag_len && memcmp(prefix->tag, query->tag, query->tag_len) == 0);
+}
+
+/* Entries start with a prefix, the lines without one continue the previous entry. The
+   lines before the first prefix of the block are an entry of unknown level and tag. */
+static bool query_block(const ulog_flash_header_t *header, const char *text, size_t len, void *arg)
+{
+    query_t *query = (query_t *) arg;
+    const char *end = text + len;
+    const char *entry = NULL;
+    ulog_entry_prefix_t prefix = {0};
+    for (const char *p = text; entry != NULL || p < end;) {
+        const char *line_end = p < end ? memchr(p, '\n', (size_t) (end - p)) : NULL;
+        line_end = line_end ? line_end + 1 : end;
+        ulog_entry_prefix_t next;
+        bool starts = p < end && ulog_entry_parse(p, (size_t) (line_end - p), &next);
+        if (!starts && p == text && p < end) {
+            next = (ulog_entry_prefix_t) { .level = ULOG_NONE };
+            starts = true;
+        }
+        if (entry != NULL && (starts || p == end)) {
+            if (entry_matches(query, &prefix)) {
+                ulog_backtrace_record_t record = {
+                    .seq = header->seq,
+                    .timestamp = prefix.timestamp,
+                    .level = prefix.level,
+                    .text = entry,
+                    .len = (size_t) (p - entry),
+                };
+                ++query->done;
+                if (!query->cb(&record, query->arg)) {
+                    return false;
+                }
+            }
+            entry = NULL;
+        }
+        if (starts) {
+            entry = p;
+            prefix = next;
+        }
+        p = line_end;
+    }
+    return true;
+}
+
+size_t ulog_flash_sink_query(ulog_flash_sink_t *sink, uint32_t from_ts, uint32_t to_ts, ulog_level_t level,
+                             const char *tag, ulog_backtrace_cb_t cb, void *arg)
+{
+    query_t query = {
+        .from_ts = from_ts,
+        .to_ts = to_ts,
+        .level = level <= ULOG_VERBOSE ? level : ULOG_VERBOSE,
+        .tag = tag,
+        .tag_len = tag ? strlen(tag) : 0,
+        .tag_hash = tag ? ulog_tag_hash_n(tag, strlen(tag)) : 0,
+        .cb = cb,
+        .arg = arg,
+    };
+    walk_blocks(sink, &query, &query_block, &query);
+    return query.done;
+}
+
+size_t ulog_flash_sink_dropped(const ulog_flash_sink_t *sink)
+{
+    return atomic_load_explicit(&sink->dropped, memory_order_relaxed);
+}
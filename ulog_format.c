@@ -0,0 +1,533 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <string.h>
+#include "ulog_private.h"
+
+const char *const ulog_level_colors[ULOG_VERBOSE + 1] = {
+    "", "" LOG_COLOR_E, "" LOG_COLOR_W, "" LOG_COLOR_I, "" LOG_COLOR_D, "" LOG_COLOR_V,
+};
+
+const char ulog_level_letters[ULOG_VERBOSE + 2] = "NEWIDV";
+
+const char ulog_digit_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+char *ulog_put_digits(char *p, uint32_t value, int digits)
+{
+    char *end = p + digits;
+    char *q = end;
+    while (digits >= 2) {
+        q -= 2;
+        memcpy(q, &ulog_digit_pairs[(value % 100) * 2], 2);
+        value /= 100;
+        digits -= 2;
+    }
+    if (digits) {
+        *--q = (char) ('0' + value % 10);
+    }
+    return end;
+}
+
+bool ulog_entry_parse(const char *text, size_t len, ulog_entry_prefix_t *prefix)
+{
+    const char *p = text;
+    const char *end = text + len;
+    if (p < end && *p == '\033') {
+        // color of the level
+        const char *color_end = memchr(p, 'm', len);
+        p = color_end ? color_end + 1 : end;
+    }
+    if (end - p < 4) {
+        return false;
+    }
+    const char *letter = memchr(ulog_level_letters + ULOG_ERROR, *p, ULOG_VERBOSE);
+    if (letter == NULL || p[1] != ' ' || p[2] != '(') {
+        return false;
+    }
+    prefix->level = (ulog_level_t) (letter - ulog_level_letters);
+    p += 3;
+    const char *close = memchr(p, ')', (size_t) (end - p));
+    if (close == NULL || end - close < 2 || close[1] != ' ') {
+        return false;
+    }
+    prefix->has_timestamp = close > p;
+    prefix->timestamp = 0;
+    for (; p < close; ++p) {
+        if (*p < '0' || *p > '9') {
+            prefix->has_timestamp = false;  // the system time
+            prefix->timestamp = 0;
+            break;
+        }
+        prefix->timestamp = prefix->timestamp * 10 + (uint32_t) (*p - '0');
+    }
+    prefix->tag = close + 2;
+    for (p = prefix->tag; p + 1 < end; ++p) {
+        if (p[0] == ':' && p[1] == ' ') {
+            prefix->tag_len = (size_t) (p - prefix->tag);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ulog_fmt_next(const char **format, ulog_fmt_spec_t *spec)
+{
+    const char *p = strchr(*format, '%');
+    if (p == NULL) {
+        *format += strlen(*format);
+        return false;
+    }
+    spec->start = p++;
+    spec->width_arg = false;
+    spec->precision_arg = false;
+    spec->precision = -1;
+
+    // flags
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        ++p;
+    }
+    // width
+    if (*p == '*') {
+        spec->width_arg = true;
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    // precision
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            spec->precision_arg = true;
+            ++p;
+        } else {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+    // length modifier
+    ulog_arg_type_t int_type = ULOG_ARG_INT;
+    bool long_double = false;
+    switch (*p) {
+    case 'h':
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            int_type = ULOG_ARG_LLONG;
+            p += 2;
+        } else {
+            int_type = ULOG_ARG_LONG;
+            p += 1;
+        }
+        break;
+    case 'q':
+        int_type = ULOG_ARG_LLONG;
+        ++p;
+        break;
+    case 'j':
+        int_type = ULOG_ARG_INTMAX;
+        ++p;
+        break;
+    case 'z':
+        int_type = ULOG_ARG_SIZE;
+        ++p;
+        break;
+    case 't':
+        int_type = ULOG_ARG_PTRDIFF;
+        ++p;
+        break;
+    case 'L':
+        long_double = true;
+        ++p;
+        break;
+    default:
+        break;
+    }
+
+    spec->conversion = *p;
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        spec->type = int_type;
+        break;
+    case 'c':
+        spec->type = ULOG_ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->type = long_double ? ULOG_ARG_LDOUBLE : ULOG_ARG_DOUBLE;
+        break;
+    case 's':
+        spec->type = ULOG_ARG_STR;
+        break;
+    case 'p': case 'n':
+        spec->type = ULOG_ARG_PTR;
+        break;
+    case '\0':
+        // truncated conversion at the end of the string
+        spec->type = ULOG_ARG_NONE;
+        spec->end = p;
+        *format = p;
+        return true;
+    default:
+        // "%%" and unknown conversions do not consume any argument
+        spec->type = ULOG_ARG_NONE;
+        break;
+    }
+    spec->end = ++p;
+    *format = p;
+    return true;
+}
+
+/* -- ulog_vsnprintf() ------------------------------------------------------ */
+
+#define FLAG_LEFT   0x01    // '-'
+#define FLAG_PLUS   0x02    // '+'
+#define FLAG_SPACE  0x04    // ' '
+#define FLAG_ALT    0x08    // '#'
+#define FLAG_ZERO   0x10    // '0'
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;     // length of the whole output, as if buf were large enough
+} out_t;
+
+static inline void out_put(out_t *out, const char *s, size_t len)
+{
+    if (out->len + 1 < out->size) {
+        size_t room = out->size - 1 - out->len;
+        memcpy(out->buf + out->len, s, len < room ? len : room);
+    }
+    out->len += len;
+}
+
+static inline void out_fill(out_t *out, char c, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    if (out->len + 1 < out->size) {
+        size_t room = out->size - 1 - out->len;
+        memset(out->buf + out->len, c, (size_t) count < room ? (size_t) count : room);
+    }
+    out->len += (size_t) count;
+}
+
+/* Digits of value in base, written backwards before end, returns the first one */
+static char *format_digits(char *end, unsigned long long value, unsigned base, bool upper)
+{
+    static const char hex_digits[2][16] = { "0123456789abcdef", "0123456789ABCDEF" };
+    char *p = end;
+    if (base == 10) {
+        // 32-bit divisions once the value fits, they are much cheaper on small cores
+        while (value > UINT32_MAX) {
+            p -= 2;
+            memcpy(p, &ulog_digit_pairs[(value % 100) * 2], 2);
+            value /= 100;
+        }
+        uint32_t value32 = (uint32_t) value;
+        while (value32 >= 100) {
+            p -= 2;
+            memcpy(p, &ulog_digit_pairs[(value32 % 100) * 2], 2);
+            value32 /= 100;
+        }
+        if (value32 >= 10) {
+            p -= 2;
+            memcpy(p, &ulog_digit_pairs[value32 * 2], 2);
+        } else if (value32 != 0) {
+            *--p = (char) ('0' + value32);
+        }
+    } else {
+        unsigned shift = base == 16 ? 4 : 3;
+        while (value) {
+            *--p = hex_digits[upper][value & (base - 1)];
+            value >>= shift;
+        }
+    }
+    return p;
+}
+
+/* One integer conversion: sign or prefix, zeros up to the precision, digits and padding */
+static void format_integer(out_t *out, const ulog_fmt_spec_t *spec, unsigned flags, int width, int precision,
+                           unsigned long long value, bool negative)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    unsigned base = 10;
+    switch (spec->conversion) {
+    case 'x': case 'X': case 'p':
+        base = 16;
+        break;
+    case 'o':
+        base = 8;
+        break;
+    default:
+        break;
+    }
+    char *start = format_digits(end, value, base, spec->conversion == 'X');
+    int len = (int) (end - start);
+    if (precision < 0) {
+        precision = 1;     // a zero is written as "0"
+    } else {
+        flags &= ~FLAG_ZERO;
+    }
+
+    char prefix[2];
+    int prefix_len = 0;
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    } else if (spec->conversion == 'd' || spec->conversion == 'i') {
+        if (flags & FLAG_PLUS) {
+            prefix[prefix_len++] = '+';
+        } else if (flags & FLAG_SPACE) {
+            prefix[prefix_len++] = ' ';
+        }
+    }
+    if (spec->conversion == 'p' || (flags & FLAG_ALT && base == 16 && value != 0)) {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = spec->conversion == 'X' ? 'X' : 'x';
+    } else if (flags & FLAG_ALT && base == 8 && precision <= len) {
+        precision = len + 1;    // the octal number starts with a zero
+    }
+
+    int zeros = precision > len ? precision - len : 0;
+    int padding = width - prefix_len - zeros - len;
+    if (flags & FLAG_ZERO && !(flags & FLAG_LEFT)) {
+        zeros += padding > 0 ? padding : 0;
+        padding = 0;
+    }
+    if (!(flags & FLAG_LEFT)) {
+        out_fill(out, ' ', padding);
+    }
+    out_put(out, prefix, (size_t) prefix_len);
+    out_fill(out, '0', zeros);
+    out_put(out, start, (size_t) len);
+    if (flags & FLAG_LEFT) {
+        out_fill(out, ' ', padding);
+    }
+}
+
+static void format_padded(out_t *out, unsigned flags, int width, const char *s, size_t len)
+{
+    int padding = width - (int) len;
+    if (!(flags & FLAG_LEFT)) {
+        out_fill(out, ' ', padding);
+    }
+    out_put(out, s, len);
+    if (flags & FLAG_LEFT) {
+        out_fill(out, ' ', padding);
+    }
+}
+
+/* Floating point conversions are left to the C library, one value at a time */
+#define FORMAT_FLOAT(dst, room, conversion, spec, width, precision, value) \
+    ((spec)->width_arg && (spec)->precision_arg ? snprintf(dst, room, conversion, width, precision, value) : \
+     (spec)->width_arg ? snprintf(dst, room, conversion, width, value) : \
+     (spec)->precision_arg ? snprintf(dst, room, conversion, precision, value) : \
+     snprintf(dst, room, conversion, value))
+
+static void format_float(out_t *out, const ulog_fmt_spec_t *spec, unsigned flags, int width, int precision,
+                         va_list *args)
+{
+    char conversion[32];
+    size_t conversion_len = (size_t) (spec->end - spec->start);
+    if (conversion_len >= sizeof(conversion)) {
+        conversion_len = 0;     // skip the argument only
+    }
+    memcpy(conversion, spec->start, conversion_len);
+    conversion[conversion_len] = '\0';
+    if (flags & FLAG_LEFT) {
+        width = -width;     // as given to '*'
+    }
+    char *dst = out->len + 1 < out->size ? out->buf + out->len : NULL;
+    size_t room = dst ? out->size - out->len : 0;
+    int ret;
+    if (spec->type == ULOG_ARG_LDOUBLE) {
+        long double value = va_arg(*args, long double);
+        ret = FORMAT_FLOAT(dst, room, conversion, spec, width, precision, value);
+    } else {
+        double value = va_arg(*args, double);
+        ret = FORMAT_FLOAT(dst, room, conversion, spec, width, precision, value);
+    }
+    if (ret > 0) {
+        out->len += (size_t) ret;
+    }
+}
+
+int ulog_vsnprintf(char *buf, size_t size, const char *format, va_list args)
+{
+    out_t out = { buf, size, 0 };
+    va_list ap;     // a copy, so that the conversions of floats can take its address
+    va_copy(ap, args);
+    ulog_fmt_spec_t spec;
+    while (true) {
+        const char *literal = format;
+        bool more = ulog_fmt_next(&format, &spec);
+        out_put(&out, literal, (size_t) ((more ? spec.start : format) - literal));
+        if (!more) {
+            break;
+        }
+
+        unsigned flags = 0;
+        int width = 0;
+        const char *p = spec.start + 1;
+        for (;; ++p) {
+            if (*p == '-') {
+                flags |= FLAG_LEFT;
+            } else if (*p == '+') {
+                flags |= FLAG_PLUS;
+            } else if (*p == ' ') {
+                flags |= FLAG_SPACE;
+            } else if (*p == '#') {
+                flags |= FLAG_ALT;
+            } else if (*p == '0') {
+                flags |= FLAG_ZERO;
+            } else if (*p != '\'') {
+                break;
+            }
+        }
+        if (spec.width_arg) {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                flags |= FLAG_LEFT;
+                width = -width;
+            }
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                width = width * 10 + (*p++ - '0');
+            }
+        }
+        int precision = spec.precision;
+        if (spec.precision_arg) {
+            precision = va_arg(ap, int);
+            if (precision < 0) {
+                precision = -1;
+            }
+        }
+        bool is_signed = spec.conversion == 'd' || spec.conversion == 'i';
+        // length modifier, for the width of char and short conversions
+        const char *length = spec.end - 2;
+        bool is_char = length >= spec.start + 2 && length[0] == 'h' && length[-1] == 'h';
+        bool is_short = !is_char && length > spec.start && length[0] == 'h';
+
+        switch (spec.type) {
+        case ULOG_ARG_NONE:
+            if (spec.conversion == '%') {
+                out_put(&out, "%", 1);
+            } else {
+                // unknown conversion, written as is
+                out_put(&out, spec.start, (size_t) (spec.end - spec.start));
+            }
+            break;
+        case ULOG_ARG_INT:
+            if (spec.conversion == 'c') {
+                char c = (char) va_arg(ap, int);
+                format_padded(&out, flags, width, &c, 1);
+            } else if (is_signed) {
+                int value = va_arg(ap, int);
+                if (is_char) {
+                    value = (signed char) value;
+                } else if (is_short) {
+                    value = (short) value;
+                }
+                unsigned long long magnitude = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+                format_integer(&out, &spec, flags, width, precision, magnitude, value < 0);
+            } else {
+                unsigned value = va_arg(ap, unsigned);
+                if (is_char) {
+                    value = (unsigned char) value;
+                } else if (is_short) {
+                    value = (unsigned short) value;
+                }
+                format_integer(&out, &spec, flags, width, precision, value, false);
+            }
+            break;
+        case ULOG_ARG_LONG:
+        case ULOG_ARG_LLONG:
+        case ULOG_ARG_INTMAX:
+        case ULOG_ARG_SIZE:
+        case ULOG_ARG_PTRDIFF: {
+            long long value;
+            unsigned long long uvalue;
+            switch (spec.type) {
+            case ULOG_ARG_LONG:
+                value = is_signed ? va_arg(ap, long) : 0;
+                uvalue = is_signed ? 0 : va_arg(ap, unsigned long);
+                break;
+            case ULOG_ARG_INTMAX:
+                value = is_signed ? va_arg(ap, intmax_t) : 0;
+                uvalue = is_signed ? 0 : va_arg(ap, uintmax_t);
+                break;
+            case ULOG_ARG_SIZE:
+                // ssize_t and size_t have the same size
+                uvalue = va_arg(ap, size_t);
+                value = (long long) (ptrdiff_t) uvalue;
+                break;
+            case ULOG_ARG_PTRDIFF:
+                value = va_arg(ap, ptrdiff_t);
+                uvalue = (unsigned long long) (size_t) value;
+                break;
+            default:
+                value = is_signed ? va_arg(ap, long long) : 0;
+                uvalue = is_signed ? 0 : va_arg(ap, unsigned long long);
+                break;
+            }
+            if (is_signed) {
+                unsigned long long magnitude = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+                format_integer(&out, &spec, flags, width, precision, magnitude, value < 0);
+            } else {
+                format_integer(&out, &spec, flags, width, precision, uvalue, false);
+            }
+            break;
+        }
+        case ULOG_ARG_PTR: {
+            void *value = va_arg(ap, void *);
+            if (spec.conversion == 'p' && value == NULL) {
+                format_padded(&out, flags, width, "(nil)", 5);     // same as glibc
+            } else if (spec.conversion == 'p') {
+                format_integer(&out, &spec, flags, width, precision, (uintptr_t) value, false);
+            }
+            // %n writes nothing
+            break;
+        }
+        case ULOG_ARG_DOUBLE:
+        case ULOG_ARG_LDOUBLE:
+            format_float(&out, &spec, flags, width, precision, &ap);
+            break;
+        case ULOG_ARG_STR: {
+            const char *value = va_arg(ap, const char *);
+            if (value == NULL) {
+                value = "(null)";
+            }
+            size_t len = precision >= 0 ? strnlen(value, (size_t) precision) : strlen(value);
+            format_padded(&out, flags, width, value, len);
+            break;
+        }
+        }
+    }
+    va_end(ap);
+    if (size > 0) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return out.len > INT_MAX ? -1 : (int) out.len;
+}
+
+int ulog_snprintf(char *buf, size_t size, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = ulog_vsnprintf(buf, size, format, list);
+    va_end(list);
+    return ret;
+}
@@ -4,6 +4,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 #include "ulog.h"
 #include "ulog_private.h"
 
@@ -16,6 +18,7 @@
 #define MAX_MUTEX_WAIT_TICKS ((MAX_MUTEX_WAIT_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
 
 static SemaphoreHandle_t s_log_mutex = NULL;
+static TaskHandle_t s_async_task = NULL;
 
 void ulog_impl_lock(void)
 {
@@ -47,6 +50,83 @@ void ulog_impl_unlock(void)
     xSemaphoreGive(s_log_mutex);
 }
 
+static void ctx_destructor(int index, void *ctx)
+{
+    (void) index;
+    ulog_ctx_release(ctx);
+}
+
+static inline bool in_task_context(void)
+{
+    return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED && !xPortInIsrContext();
+}
+
+void *ulog_impl_thread_ctx_get(void)
+{
+    if (!in_task_context()) {
+        // the pointer of the interrupted task must not be used
+        return NULL;
+    }
+    return pvTaskGetThreadLocalStoragePointer(NULL, CONFIG_LOG_THREAD_LOCAL_STORAGE_INDEX);
+}
+
+bool ulog_impl_thread_ctx_set(void *ctx)
+{
+    if (!in_task_context()) {
+        return false;
+    }
+    vTaskSetThreadLocalStoragePointerAndDelCallback(NULL, CONFIG_LOG_THREAD_LOCAL_STORAGE_INDEX, ctx, &ctx_destructor);
+    return true;
+}
+
+bool ulog_impl_async_start(void (*task)(void *), void *arg)
+{
+    return xTaskCreate(task, "ulog", CONFIG_LOG_ASYNC_TASK_STACK_SIZE, arg,
+                       CONFIG_LOG_ASYNC_TASK_PRIORITY, &s_async_task) == pdPASS;
+}
+
+void ulog_impl_async_wait(uint32_t timeout_ms)
+{
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
+
+void ulog_impl_async_notify(void)
+{
+    if (xPortInIsrContext()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_async_task, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+        xTaskNotifyGive(s_async_task);
+    }
+}
+
+void ulog_impl_yield(void)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        vTaskDelay(1);
+    }
+}
+
+unsigned ulog_impl_shard(void)
+{
+    return xPortGetCoreID();
+}
+
+/* The system timer is shared by the cores, unlike their cycle counters, and is not
+   moved by SNTP like the time of day: records of every core can be ordered by it */
+uint32_t ulog_impl_time_us(void)
+{
+    return (uint32_t) esp_timer_get_time();
+}
+
+#if CONFIG_LOG_PROFILE
+uint32_t ulog_impl_cycles(void)
+{
+    return (uint32_t) esp_cpu_get_cycle_count();
+}
+#endif
+
 char *ulog_system_timestamp(void)
 {
     static char buffer[18] = {0};
@@ -69,21 +149,35 @@ char *ulog_system_timestamp(void)
         return buffer;
     } else {
         struct timeval tv;
-        struct tm timeinfo;
-
         gettimeofday(&tv, NULL);
-        localtime_r(&tv.tv_sec, &timeinfo);
 
-        _lock_acquire(&bufferLock);
-        snprintf(buffer, sizeof(buffer),
-                 "%02d:%02d:%02d.%03ld",
-                 timeinfo.tm_hour,
-                 timeinfo.tm_min,
-                 timeinfo.tm_sec,
-                 tv.tv_usec / 1000);
-        _lock_release(&bufferLock);
+        ulog_ctx_t *ctx = ulog_ctx_get();
+        if (ctx == NULL) {
+            // ISR, or the context could not be allocated
+            _lock_acquire(&bufferLock);
+        }
+        char *buf = ctx ? ctx->timestamp : buffer;
+        // "HH:MM:SS" is only formatted again when the second changes
+        if (ctx == NULL || ctx->timestamp_sec != tv.tv_sec) {
+            struct tm timeinfo;
+            localtime_r(&tv.tv_sec, &timeinfo);
+            char *p = ulog_put_digits(buf, (uint32_t) timeinfo.tm_hour, 2);
+            *p++ = ':';
+            p = ulog_put_digits(p, (uint32_t) timeinfo.tm_min, 2);
+            *p++ = ':';
+            ulog_put_digits(p, (uint32_t) timeinfo.tm_sec, 2);
+            if (ctx) {
+                ctx->timestamp_sec = tv.tv_sec;
+            }
+        }
+        buf[8] = '.';
+        ulog_put_digits(buf + 9, (uint32_t) tv.tv_usec / 1000, 3);
+        buf[12] = '\0';
+        if (ctx == NULL) {
+            _lock_release(&bufferLock);
+        }
 
-        return buffer;
+        return buf;
     }
 }
 
@@ -92,12 +186,8 @@ uint32_t ulog_timestamp(void)
     if (unlikely(xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)) {
         return ulog_early_timestamp();
     }
-    static uint32_t base = 0;
-    if (base == 0 && xPortGetCoreID() == 0) {
-        base = ulog_early_timestamp();
-    }
-    TickType_t tick_count = xPortInIsrContext() ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
-    return base + tick_count * (1000 / configTICK_RATE_HZ);
+    // time since boot, the same on every core and continuing the early timestamp
+    return (uint32_t) (esp_timer_get_time() / 1000);
 }
 
 /* FIXME: define an API for getting the timestamp in soc/hal IDF-2351 */
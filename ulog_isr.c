@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_ISR
+
+#if !CONFIG_LOG_ASYNC
+#error "CONFIG_LOG_ISR requires CONFIG_LOG_ASYNC, records are written by the drain task"
+#endif
+
+/* A multi-producer, single consumer ring of binary records. Producers reserve room
+   by moving the head with a compare-and-swap, then publish their slot by setting
+   SLOT_READY in its header word. The consumer stops at the first slot which is not
+   ready yet, and clears every slot it consumes, so that a header which is not
+   published yet always reads as zero. Slots are 4-byte
+   aligned and never wrap, a padding slot fills the end of the buffer if needed.
+*/
+
+#define RING_SIZE       CONFIG_LOG_ISR_RING_SIZE
+#define SLOT_ALIGN(len) (((len) + 3) & ~(uint32_t) 3)
+#define SLOT_READY      0x80000000u
+#define SLOT_PADDING    0x40000000u
+#define SLOT_LEN_MASK   0x0000ffffu     // length of the slot, header included
+
+_Static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "CONFIG_LOG_ISR_RING_SIZE must be a power of 2");
+_Static_assert(RING_SIZE <= SLOT_LEN_MASK, "CONFIG_LOG_ISR_RING_SIZE is too large");
+
+static struct {
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+    _Alignas(4) uint8_t buf[RING_SIZE];
+} s_isr;
+
+// text of the record being written, only used by the drain task
+static char s_text[CONFIG_LOG_LINE_BUFFER_SIZE];
+
+static inline atomic_uint *slot_header(uint32_t pos)
+{
+    return (atomic_uint *) &s_isr.buf[pos & (RING_SIZE - 1)];
+}
+
+uint32_t ulog_isr_dropped(void)
+{
+    return atomic_load_explicit(&s_isr.dropped, memory_order_relaxed);
+}
+
+void ulog_write_isr(ulog_level_t level, const char *tag, const char *format, ...)
+{
+    if (level > ulog_level_lookup(tag)) {
+        return;
+    }
+    uint8_t record[CONFIG_LOG_ISR_RECORD_MAX];
+    va_list list;
+    va_start(list, format);
+    size_t len = ulog_binary_encode(record, sizeof(record), level, tag, format, list);
+    va_end(list);
+
+    uint32_t need = SLOT_ALIGN(sizeof(uint32_t) + len);
+    uint32_t head = atomic_load_explicit(&s_isr.head, memory_order_relaxed);
+    uint32_t padding;
+    do {
+        uint32_t tail = atomic_load_explicit(&s_isr.tail, memory_order_acquire);
+        uint32_t contiguous = RING_SIZE - (head & (RING_SIZE - 1));
+        padding = contiguous < need ? contiguous : 0;
+        if (RING_SIZE - (head - tail) < padding + need) {
+            atomic_fetch_add_explicit(&s_isr.dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&s_isr.head, &head, head + padding + need,
+                                                    memory_order_relaxed, memory_order_relaxed));
+
+    if (padding) {
+        atomic_store_explicit(slot_header(head), SLOT_READY | SLOT_PADDING | padding, memory_order_release);
+        head += padding;
+    }
+    memcpy(&s_isr.buf[(head & (RING_SIZE - 1)) + sizeof(uint32_t)], record, len);
+    atomic_store_explicit(slot_header(head), SLOT_READY | need, memory_order_release);
+
+    // wake up the drain task early if the ring is filling up or the entry is an error
+    uint32_t tail = atomic_load_explicit(&s_isr.tail, memory_order_relaxed);
+    if (head + need - tail > RING_SIZE / 2 || level == ULOG_ERROR) {
+        ulog_async_wake();
+    }
+}
+
+/* Text of a record, in the same layout as the ULOGx macros with ulog_timestamp() */
+static size_t format_record(const ulog_binary_record_t *record)
+{
+    const char reset[] = LOG_RESET_COLOR "\n";
+    size_t room = sizeof(s_text) - (sizeof(reset) - 1);
+    int ret = ulog_format_snprintf(s_text, room, "%s%c (%" PRIu32 ") %s: ", ulog_level_color(record->level),
+                       ulog_level_letter(record->level), record->timestamp, record->tag);
+    size_t len = (ret < 0) ? 0 : ((size_t) ret < room ? (size_t) ret : room - 1);
+    len += ulog_binary_format(s_text + len, room - len, record);
+    memcpy(s_text + len, reset, sizeof(reset));
+    return len + sizeof(reset) - 1;
+}
+
+void ulog_isr_drain(void)
+{
+    uint32_t tail = atomic_load_explicit(&s_isr.tail, memory_order_relaxed);
+    while (true) {
+        atomic_uint *header = slot_header(tail);
+        uint32_t slot = atomic_load_explicit(header, memory_order_acquire);
+        if (!(slot & SLOT_READY)) {
+            break;
+        }
+        uint32_t slot_len = slot & SLOT_LEN_MASK;
+        if (!(slot & SLOT_PADDING)) {
+            ulog_binary_record_t record;
+            const uint8_t *data = (const uint8_t *) header + sizeof(uint32_t);
+            if (ulog_binary_decode(data, slot_len - sizeof(uint32_t), &record)) {
+                size_t len = format_record(&record);
+                ulog_output_text(record.level, record.tag, s_text, len);
+            }
+        }
+        memset((void *) header, 0, slot_len);
+        tail += slot_len;
+        atomic_store_explicit(&s_isr.tail, tail, memory_order_release);
+    }
+}
+
+#endif // CONFIG_LOG_ISR
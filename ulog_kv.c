@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+/* -- CBOR encoding -------------------------------------------------------- */
+
+#define CBOR_UINT           0
+#define CBOR_NEGATIVE       1
+#define CBOR_BYTES          2
+#define CBOR_TEXT           3
+#define CBOR_ARRAY          4
+
+#define CBOR_FALSE          0xf4
+#define CBOR_TRUE           0xf5
+#define CBOR_DOUBLE         0xfb
+#define CBOR_MAP_INDEFINITE 0xbf
+#define CBOR_BREAK          0xff
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+} cbor_writer_t;
+
+static inline void put_be(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i) {
+        p[i] = (uint8_t) value;
+        value >>= 8;
+    }
+}
+
+/* Initial byte and argument of an item, in the shortest form */
+static bool cbor_head(cbor_writer_t *w, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t len;
+    if (value < 24) {
+        head[0] = (uint8_t) (major << 5 | value);
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = (uint8_t) (major << 5 | 24);
+        head[1] = (uint8_t) value;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = (uint8_t) (major << 5 | 25);
+        put_be(head + 1, value, 2);
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = (uint8_t) (major << 5 | 26);
+        put_be(head + 1, value, 4);
+        len = 5;
+    } else {
+        head[0] = (uint8_t) (major << 5 | 27);
+        put_be(head + 1, value, 8);
+        len = 9;
+    }
+    if ((size_t) (w->end - w->p) < len) {
+        return false;
+    }
+    memcpy(w->p, head, len);
+    w->p += len;
+    return true;
+}
+
+static bool cbor_byte(cbor_writer_t *w, uint8_t byte)
+{
+    if (w->p == w->end) {
+        return false;
+    }
+    *w->p++ = byte;
+    return true;
+}
+
+static bool cbor_string(cbor_writer_t *w, uint8_t major, const void *data, size_t len)
+{
+    if (!cbor_head(w, major, len) || (size_t) (w->end - w->p) < len) {
+        return false;
+    }
+    memcpy(w->p, data, len);
+    w->p += len;
+    return true;
+}
+
+static bool cbor_value(cbor_writer_t *w, const ulog_kv_t *kv)
+{
+    switch (kv->type) {
+    case ULOG_KV_UINT:
+        return cbor_head(w, CBOR_UINT, kv->value.u);
+    case ULOG_KV_INT:
+        if (kv->value.i < 0) {
+            return cbor_head(w, CBOR_NEGATIVE, (uint64_t) -(kv->value.i + 1));
+        }
+        return cbor_head(w, CBOR_UINT, (uint64_t) kv->value.i);
+    case ULOG_KV_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &kv->value.d, sizeof(bits));
+        if (w->end - w->p < 9) {
+            return false;
+        }
+        *w->p = CBOR_DOUBLE;
+        put_be(w->p + 1, bits, 8);
+        w->p += 9;
+        return true;
+    }
+    case ULOG_KV_BOOL:
+        return cbor_byte(w, kv->value.b ? CBOR_TRUE : CBOR_FALSE);
+    case ULOG_KV_STR:
+        return cbor_string(w, CBOR_TEXT, kv->value.str, strlen(kv->value.str));
+    case ULOG_KV_BYTES:
+        return cbor_string(w, CBOR_BYTES, kv->value.bytes, kv->len);
+    }
+    return false;
+}
+
+/* Record described in ulog_kv.h, the fields which do not fit are left out */
+static size_t kv_encode(uint8_t *buf, size_t size, uint32_t timestamp, ulog_level_t level,
+                        const char *tag, const char *msg, const ulog_kv_t *fields, size_t count)
+{
+    cbor_writer_t w = { buf, buf + size - 1 };  // room for the break of the map
+    if (!cbor_head(&w, CBOR_ARRAY, 5) || !cbor_head(&w, CBOR_UINT, timestamp) ||
+            !cbor_head(&w, CBOR_UINT, level) || !cbor_string(&w, CBOR_TEXT, tag, strlen(tag)) ||
+            !cbor_string(&w, CBOR_TEXT, msg, strlen(msg)) || !cbor_byte(&w, CBOR_MAP_INDEFINITE)) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *field = w.p;
+        if (!cbor_string(&w, CBOR_TEXT, fields[i].key, strlen(fields[i].key)) || !cbor_value(&w, &fields[i])) {
+            w.p = field;
+        }
+    }
+    *w.p++ = CBOR_BREAK;
+    return (size_t) (w.p - buf);
+}
+
+/* -- text rendering ------------------------------------------------------- */
+
+typedef struct {
+    char *p;
+    char *end;
+} text_writer_t;
+
+static void text_put(text_writer_t *w, const char *s, size_t len)
+{
+    size_t room = (size_t) (w->end - w->p);
+    if (len > room) {
+        len = room;
+    }
+    memcpy(w->p, s, len);
+    w->p += len;
+}
+
+static void text_put_uint(text_writer_t *w, uint64_t value)
+{
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    do {
+        *--p = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+    text_put(w, p, (size_t) (digits + sizeof(digits) - p));
+}
+
+static void text_put_value(text_writer_t *w, const ulog_kv_t *kv)
+{
+    static const char hex_digits[16] = "0123456789abcdef";
+    switch (kv->type) {
+    case ULOG_KV_UINT:
+        text_put_uint(w, kv->value.u);
+        break;
+    case ULOG_KV_INT:
+        if (kv->value.i < 0) {
+            text_put(w, "-", 1);
+            text_put_uint(w, -(uint64_t) kv->value.i);
+        } else {
+            text_put_uint(w, (uint64_t) kv->value.i);
+        }
+        break;
+    case ULOG_KV_DOUBLE: {
+        char number[32];
+        int len = snprintf(number, sizeof(number), "%g", kv->value.d);
+        if (len > 0) {
+            text_put(w, number, (size_t) len < sizeof(number) ? (size_t) len : sizeof(number) - 1);
+        }
+        break;
+    }
+    case ULOG_KV_BOOL:
+        if (kv->value.b) {
+            text_put(w, "true", 4);
+        } else {
+            text_put(w, "false", 5);
+        }
+        break;
+    case ULOG_KV_STR:
+        text_put(w, "\"", 1);
+        text_put(w, kv->value.str, strlen(kv->value.str));
+        text_put(w, "\"", 1);
+        break;
+    case ULOG_KV_BYTES: {
+        const uint8_t *bytes = (const uint8_t *) kv->value.bytes;
+        for (size_t i = 0; i < kv->len && w->p < w->end; ++i) {
+            char hex[2] = { hex_digits[bytes[i] >> 4], hex_digits[bytes[i] & 0x0f] };
+            text_put(w, hex, 2);
+        }
+        break;
+    }
+    }
+}
+
+/* Same line as the ULOGx macros, the message followed by the fields, truncated to size */
+static size_t kv_render(char *line, size_t size, uint32_t timestamp, ulog_level_t level,
+                        const char *tag, const char *msg, const ulog_kv_t *fields, size_t count)
+{
+    const char reset[] = LOG_RESET_COLOR "\n";
+    size_t room = size - (sizeof(reset) - 1);
+#if CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+    (void) timestamp;
+    int ret = snprintf(line, room, "%s%c (%s) %s: ", ulog_level_color(level), ulog_level_letter(level),
+                       ulog_system_timestamp(), tag);
+#else
+    int ret = snprintf(line, room, "%s%c (%" PRIu32 ") %s: ", ulog_level_color(level),
+                       ulog_level_letter(level), timestamp, tag);
+#endif
+    size_t len = (ret < 0) ? 0 : ((size_t) ret < room ? (size_t) ret : room - 1);
+    text_writer_t w = { line + len, line + room - 1 };
+    text_put(&w, msg, strlen(msg));
+    for (size_t i = 0; i < count; ++i) {
+        text_put(&w, " ", 1);
+        text_put(&w, fields[i].key, strlen(fields[i].key));
+        text_put(&w, "=", 1);
+        text_put_value(&w, &fields[i]);
+    }
+    memcpy(w.p, reset, sizeof(reset));
+    return (size_t) (w.p - line) + sizeof(reset) - 1;
+}
+
+/* -- output --------------------------------------------------------------- */
+
+static void output_text(ulog_level_t level, uint32_t sinks, bool backtrace, char *line, size_t size,
+                        uint32_t timestamp, const char *tag, const char *msg, const ulog_kv_t *fields, size_t count)
+{
+    uint32_t start = ulog_profile_cycles();
+    size_t len = kv_render(line, size, timestamp, level, tag, msg, fields, count);
+    uint32_t formatted = ulog_profile_cycles();
+    ulog_dispatch(level, sinks, backtrace, line, len);
+    ulog_profile_entry(tag, len, formatted - start, ulog_profile_cycles() - formatted);
+}
+
+/* Entry logged without a log context, or from a sink while the context line is in use */
+static __attribute__((noinline)) void output_text_on_stack(ulog_level_t level, uint32_t sinks, bool backtrace,
+                                                           uint32_t timestamp, const char *tag, const char *msg,
+                                                           const ulog_kv_t *fields, size_t count)
+{
+    char line[CONFIG_LOG_LINE_BUFFER_SIZE];
+    output_text(level, sinks, backtrace, line, sizeof(line), timestamp, tag, msg, fields, count);
+}
+
+void ulog_write_kv_unchecked(ulog_level_t level, const char *tag, const char *msg, const ulog_kv_t *fields, size_t count)
+{
+    uint32_t sinks = ulog_sinks_accept(level, tag);
+    uint32_t structured = sinks & ulog_sinks_structured();
+    sinks &= ~structured;
+#if CONFIG_LOG_BACKTRACE
+    bool backtrace = level <= ulog_backtrace_level();
+#else
+    const bool backtrace = false;
+#endif
+    if (sinks == 0 && structured == 0 && !backtrace) {
+        ULOG_STATS_INC(filtered[level]);
+        ulog_profile_filtered(tag);
+        return;
+    }
+    ULOG_STATS_INC(emitted[level]);
+    uint32_t timestamp = ulog_timestamp();
+
+    if (structured) {
+        uint8_t record[CONFIG_LOG_KV_RECORD_MAX];
+        size_t len = kv_encode(record, sizeof(record), timestamp, level, tag, msg, fields, count);
+        if (len) {
+            ulog_dispatch(level, structured, false, (const char *) record, len);
+        }
+    }
+    if (sinks == 0 && !backtrace) {
+        return;
+    }
+    ulog_ctx_t *ctx = ulog_ctx_get();
+    if (ctx == NULL || ctx->busy) {
+        output_text_on_stack(level, sinks, backtrace, timestamp, tag, msg, fields, count);
+        return;
+    }
+    ctx->busy = true;
+    output_text(level, sinks, backtrace, ctx->line, sizeof(ctx->line), timestamp, tag, msg, fields, count);
+    ctx->busy = false;
+}
+
+void ulog_write_kv(ulog_level_t level, const char *tag, const char *msg, const ulog_kv_t *fields, size_t count)
+{
+    if (!ulog_enabled(tag, level)) {
+        return;
+    }
+    ulog_write_kv_unchecked(level, tag, msg, fields, count);
+}
@@ -1,14 +1,31 @@
 #include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include "ulog_private.h"
 
 static pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t s_ctx_key;
+static pthread_once_t s_ctx_key_once = PTHREAD_ONCE_INIT;
+static sem_t s_async_sem;
 
 void ulog_impl_lock(void)
 {
-    assert(pthread_mutex_lock(&mutex1) == 0);
+    int result = pthread_mutex_lock(&mutex1);
+    assert(result == 0);
+    (void) result;
 }
 
 bool ulog_impl_lock_timeout(void)
@@ -19,7 +36,9 @@ bool ulog_impl_lock_timeout(void)
 
 void ulog_impl_unlock(void)
 {
-    assert(pthread_mutex_unlock(&mutex1) == 0);
+    int result = pthread_mutex_unlock(&mutex1);
+    assert(result == 0);
+    (void) result;
 }
 
 uint32_t ulog_timestamp(void)
@@ -27,17 +46,610 @@ uint32_t ulog_timestamp(void)
     struct timespec current_time;
     int result = clock_gettime(CLOCK_MONOTONIC, &current_time);
     assert(result == 0);
+    (void) result;
     uint32_t milliseconds = current_time.tv_sec * 1000 + current_time.tv_nsec / 1000000;
     return milliseconds;
 }
 
+#if CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION != 0 && CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION != 3 && \
+    CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION != 6
+#error "CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION must be 0, 3 or 6"
+#endif
+
+#define TIMESTAMP_PREFIX_LEN 19     // "YYYY-MM-DD HH:MM:SS"
+
+/* Format "YYYY-MM-DD HH:MM:SS" only when the second changes, the fraction
+   is appended to the cached prefix on every call.
+*/
+static void format_timestamp(char *buf, int64_t *cached_sec, const struct timespec *now)
+{
+    if (now->tv_sec != *cached_sec) {
+        struct tm timeinfo;
+        localtime_r(&now->tv_sec, &timeinfo);
+        char *p = buf;
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_year + 1900, 4);
+        *p++ = '-';
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_mon + 1, 2);
+        *p++ = '-';
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_mday, 2);
+        *p++ = ' ';
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_hour, 2);
+        *p++ = ':';
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_min, 2);
+        *p++ = ':';
+        p = ulog_put_digits(p, (uint32_t) timeinfo.tm_sec, 2);
+        *cached_sec = now->tv_sec;
+    }
+    char *p = buf + TIMESTAMP_PREFIX_LEN;
+#if CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION == 3
+    *p++ = '.';
+    p = ulog_put_digits(p, (uint32_t) now->tv_nsec / 1000000, 3);
+#elif CONFIG_LOG_SYSTEM_TIMESTAMP_PRECISION == 6
+    *p++ = '.';
+    p = ulog_put_digits(p, (uint32_t) now->tv_nsec / 1000, 6);
+#endif
+    *p = '\0';
+}
+
 char *ulog_system_timestamp(void)
 {
-    time_t timep;
-    struct tm* timeinfo;
-    static char buf[30];
-    time(&timep); /*获取time_t类型的当前时间*/
-    timeinfo = localtime(&timep);
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", timeinfo);
-    return buf;
+    static char shared_buf[32];     // used by threads without a log context
+    struct timespec now;
+#if CONFIG_LOG_SYSTEM_TIMESTAMP_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    ulog_ctx_t *ctx = ulog_ctx_get();
+    if (ctx == NULL) {
+        int64_t no_cache = -1;
+        format_timestamp(shared_buf, &no_cache, &now);
+        return shared_buf;
+    }
+    format_timestamp(ctx->timestamp, &ctx->timestamp_sec, &now);
+    return ctx->timestamp;
+}
+
+static void ctx_key_create(void)
+{
+    int result = pthread_key_create(&s_ctx_key, &ulog_ctx_release);
+    assert(result == 0);
+    (void) result;
+}
+
+void *ulog_impl_thread_ctx_get(void)
+{
+    pthread_once(&s_ctx_key_once, &ctx_key_create);
+    return pthread_getspecific(s_ctx_key);
+}
+
+bool ulog_impl_thread_ctx_set(void *ctx)
+{
+    pthread_once(&s_ctx_key_once, &ctx_key_create);
+    return pthread_setspecific(s_ctx_key, ctx) == 0;
+}
+
+typedef struct {
+    void (*task)(void *);
+    void *arg;
+} async_task_args_t;
+
+static void *async_thread(void *args)
+{
+    async_task_args_t task_args = *(async_task_args_t *) args;
+    free(args);
+    task_args.task(task_args.arg);
+    return NULL;
+}
+
+bool ulog_impl_async_start(void (*task)(void *), void *arg)
+{
+    async_task_args_t *args = malloc(sizeof(async_task_args_t));
+    if (args == NULL) {
+        return false;
+    }
+    args->task = task;
+    args->arg = arg;
+    if (sem_init(&s_async_sem, 0, 0) != 0) {
+        free(args);
+        return false;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &async_thread, args) != 0) {
+        free(args);
+        return false;
+    }
+    pthread_detach(thread);
+    // entries still in the ring buffers would be lost when the process exits
+    atexit(&ulog_async_flush);
+    return true;
+}
+
+void ulog_impl_async_wait(uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&s_async_sem, &deadline) != 0 && errno == EINTR) {
+    }
+}
+
+void ulog_impl_async_notify(void)
+{
+    sem_post(&s_async_sem);
+}
+
+void ulog_impl_yield(void)
+{
+    sched_yield();
+}
+
+unsigned ulog_impl_shard(void)
+{
+    // a shard per thread, handed out in turn: cheaper than sched_getcpu()
+    static atomic_uint s_next_shard;
+    static _Thread_local unsigned s_shard = UINT_MAX;
+    if (s_shard == UINT_MAX) {
+        s_shard = atomic_fetch_add_explicit(&s_next_shard, 1, memory_order_relaxed) & (UINT_MAX >> 1);
+    }
+    return s_shard;
+}
+
+uint32_t ulog_impl_time_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000u + (uint64_t) now.tv_nsec / 1000);
+}
+
+#if CONFIG_LOG_PROFILE
+uint32_t ulog_impl_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t) __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    // ticks of the generic timer, the cycle counter is not readable from user space
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return (uint32_t) ticks;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec);
+#endif
+}
+#endif
+
+/* -- file descriptor sink ------------------------------------------------- */
+
+struct ulog_fd_sink {
+    pthread_mutex_t mutex;
+    ulog_fd_sink_config_t config;
+    char *buf;
+    size_t size;
+    size_t len;
+    size_t flushed;     // bytes of buf already in the file, the partial block of O_DIRECT
+    off_t offset;       // O_DIRECT: file offset of buf, a multiple of ULOG_FD_SINK_ALIGN
+    uint32_t first_ts;  // ulog_timestamp() of the oldest entry not flushed yet
+};
+
+static void writev_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; // the entries are lost, like with a failing console
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+static void pwrite_all(int fd, const char *buf, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t written = pwrite(fd, buf, len, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += written;
+        len -= written;
+        offset += written;
+    }
+}
+
+static void fd_sink_flush_locked(ulog_fd_sink_t *sink)
+{
+    if (sink->len == sink->flushed) {
+        return;
+    }
+    if (sink->config.direct) {
+        // whole blocks only, the partial block is written again by the next flush
+        size_t aligned = (sink->len + ULOG_FD_SINK_ALIGN - 1) & ~(size_t) (ULOG_FD_SINK_ALIGN - 1);
+        memset(sink->buf + sink->len, 0, aligned - sink->len);
+        pwrite_all(sink->config.fd, sink->buf, aligned, sink->offset);
+        size_t full = sink->len & ~(size_t) (ULOG_FD_SINK_ALIGN - 1);
+        memmove(sink->buf, sink->buf + full, sink->len - full);
+        sink->offset += full;
+        sink->len -= full;
+        sink->flushed = sink->len;
+    } else {
+        struct iovec iov = { .iov_base = sink->buf, .iov_len = sink->len };
+        writev_all(sink->config.fd, &iov, 1);
+        sink->len = 0;
+        sink->flushed = 0;
+    }
+    if (sink->config.datasync) {
+        fdatasync(sink->config.fd);
+    }
+}
+
+ulog_fd_sink_t *ulog_fd_sink_create(const ulog_fd_sink_config_t *config)
+{
+    ulog_fd_sink_t *sink = calloc(1, sizeof(ulog_fd_sink_t));
+    if (sink == NULL) {
+        return NULL;
+    }
+    sink->config = *config;
+    sink->size = (config->buffer_size + ULOG_FD_SINK_ALIGN - 1) & ~(size_t) (ULOG_FD_SINK_ALIGN - 1);
+    if (sink->size == 0) {
+        sink->size = ULOG_FD_SINK_ALIGN;
+    }
+    if (posix_memalign((void **) &sink->buf, ULOG_FD_SINK_ALIGN, sink->size) != 0) {
+        free(sink);
+        return NULL;
+    }
+    if (config->direct) {
+        // append after the entries already in the file, reading back its partial block
+        off_t end = lseek(config->fd, 0, SEEK_END);
+        sink->offset = end > 0 ? end & ~(off_t) (ULOG_FD_SINK_ALIGN - 1) : 0;
+        if (end > sink->offset &&
+                pread(config->fd, sink->buf, ULOG_FD_SINK_ALIGN, sink->offset) >= end - sink->offset) {
+            sink->len = end - sink->offset;
+            sink->flushed = sink->len;
+        }
+    }
+    pthread_mutex_init(&sink->mutex, NULL);
+    return sink;
+}
+
+void ulog_fd_sink_flush(ulog_fd_sink_t *sink)
+{
+    pthread_mutex_lock(&sink->mutex);
+    fd_sink_flush_locked(sink);
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+void ulog_fd_sink_destroy(ulog_fd_sink_t *sink)
+{
+    if (sink == NULL) {
+        return;
+    }
+    fd_sink_flush_locked(sink);
+    if (sink->config.direct) {
+        int result = ftruncate(sink->config.fd, sink->offset + sink->len);
+        (void) result;
+    }
+    pthread_mutex_destroy(&sink->mutex);
+    free(sink->buf);
+    free(sink);
+}
+
+void ulog_fd_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    ulog_fd_sink_t *sink = (ulog_fd_sink_t *) ctx;
+    uint32_t now = ulog_timestamp();
+    pthread_mutex_lock(&sink->mutex);
+    if (sink->len == sink->flushed) {
+        sink->first_ts = now;
+    }
+    if (sink->config.direct) {
+        while (len > 0) {
+            size_t copied = sink->size - sink->len < len ? sink->size - sink->len : len;
+            memcpy(sink->buf + sink->len, buf, copied);
+            sink->len += copied;
+            buf += copied;
+            len -= copied;
+            if (sink->len == sink->size) {
+                fd_sink_flush_locked(sink);
+            }
+        }
+    } else if (sink->len + len > sink->size) {
+        // the buffer and the entry in one system call, without copying the entry
+        struct iovec iov[2] = {
+            { .iov_base = sink->buf, .iov_len = sink->len },
+            { .iov_base = (void *) buf, .iov_len = len },
+        };
+        writev_all(sink->config.fd, iov, 2);
+        sink->len = 0;
+        if (sink->config.datasync) {
+            fdatasync(sink->config.fd);
+        }
+        pthread_mutex_unlock(&sink->mutex);
+        return;
+    } else {
+        memcpy(sink->buf + sink->len, buf, len);
+        sink->len += len;
+    }
+    if (level <= sink->config.flush_level || now - sink->first_ts >= sink->config.flush_period_ms) {
+        fd_sink_flush_locked(sink);
+    }
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+void ulog_fd_sink_poll(void *ctx)
+{
+    ulog_fd_sink_t *sink = (ulog_fd_sink_t *) ctx;
+    pthread_mutex_lock(&sink->mutex);
+    if (sink->len != sink->flushed && ulog_timestamp() - sink->first_ts >= sink->config.flush_period_ms) {
+        fd_sink_flush_locked(sink);
+    }
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+/* -- memory-mapped sink --------------------------------------------------- */
+
+#define MMAP_HEADER_SIZE    64
+#define SEGMENT_CLOSED      (SIZE_MAX / 2)
+
+_Static_assert(sizeof(ulog_mmap_header_t) <= MMAP_HEADER_SIZE, "segment header too large");
+
+/* Writers reserve room in the current segment by incrementing reserved, and
+   publish their entries in the order of the reservations by moving the end offset
+   of the header. The writer whose reservation crosses the limit rotates the
+   segment, once the entries before it are published: the writers after it wait
+   for the new segment. A segment which is not current has reserved past the limit,
+   so that a writer which loaded it before the rotation takes the slow path again.
+*/
+typedef struct {
+    atomic_size_t reserved;
+    ulog_mmap_header_t *header;     // start of the mapping, NULL for a free slot
+    int fd;
+} mmap_segment_t;
+
+struct ulog_mmap_sink {
+    pthread_mutex_t mutex;          // rotation and preparation of the segments
+    char *path;
+    size_t size;
+    size_t limit;                   // bytes of entries in a segment
+    unsigned count;
+    uint64_t seq;                   // sequence number of the last segment prepared
+    unsigned index;                 // file of the last segment prepared
+    mmap_segment_t segments[3];     // current, next and retired
+    _Atomic(mmap_segment_t *) current;
+    mmap_segment_t *next;
+    mmap_segment_t *retired;
+};
+
+static mmap_segment_t *mmap_segment_prepare(ulog_mmap_sink_t *sink)
+{
+    mmap_segment_t *seg = NULL;
+    for (int i = 0; i < 3 && seg == NULL; ++i) {
+        if (sink->segments[i].header == NULL) {
+            seg = &sink->segments[i];
+        }
+    }
+    if (seg == NULL) {
+        return NULL;
+    }
+    unsigned index = (sink->index + 1) % sink->count;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%u", sink->path, index);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    // drop the entries of the previous use of the file, and allocate all its blocks
+    if (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, sink->size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    ulog_mmap_header_t *header = mmap(NULL, sink->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (header == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    header->magic = ULOG_MMAP_MAGIC;
+    header->header_size = MMAP_HEADER_SIZE;
+    header->seq = ++sink->seq;
+    header->end = MMAP_HEADER_SIZE;
+    header->sealed = 0;
+    sink->index = index;
+    atomic_store_explicit(&seg->reserved, SEGMENT_CLOSED, memory_order_relaxed);
+    seg->header = header;
+    seg->fd = fd;
+    return seg;
+}
+
+static void mmap_segment_release(ulog_mmap_sink_t *sink, mmap_segment_t *seg, off_t length)
+{
+    munmap(seg->header, sink->size);
+    if (length >= 0) {
+        int result = ftruncate(seg->fd, length);
+        (void) result;
+    }
+    close(seg->fd);
+    seg->header = NULL;
+}
+
+/* With sink->mutex held */
+static void mmap_segment_install(ulog_mmap_sink_t *sink, mmap_segment_t *seg)
+{
+    if (seg != NULL) {
+        atomic_store_explicit(&seg->reserved, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&sink->current, seg, memory_order_release);
+}
+
+/* Called by the writer whose reservation crossed the limit of seg, once the
+   entries before it are published */
+static void mmap_sink_rotate(ulog_mmap_sink_t *sink, mmap_segment_t *seg)
+{
+    pthread_mutex_lock(&sink->mutex);
+    __atomic_store_n(&seg->header->sealed, 1, __ATOMIC_RELEASE);
+    if (sink->retired != NULL) {
+        mmap_segment_release(sink, sink->retired, -1);
+    }
+    mmap_segment_t *next = sink->next != NULL ? sink->next : mmap_segment_prepare(sink);
+    sink->next = NULL;
+    sink->retired = seg;
+    // without a next segment, entries are dropped until one can be prepared
+    mmap_segment_install(sink, next);
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+ulog_mmap_sink_t *ulog_mmap_sink_create(const ulog_mmap_sink_config_t *config)
+{
+    if (config->segment_count == 0) {
+        return NULL;
+    }
+    ulog_mmap_sink_t *sink = calloc(1, sizeof(ulog_mmap_sink_t));
+    if (sink == NULL) {
+        return NULL;
+    }
+    sink->path = strdup(config->path);
+    if (sink->path == NULL) {
+        free(sink);
+        return NULL;
+    }
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    sink->size = (config->segment_size + page - 1) / page * page;
+    if (sink->size <= MMAP_HEADER_SIZE) {
+        sink->size = page;
+    }
+    sink->limit = sink->size - MMAP_HEADER_SIZE;
+    sink->count = config->segment_count;
+
+    // resume after the latest segment
+    sink->index = sink->count - 1;
+    for (unsigned index = 0; index < sink->count; ++index) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.%u", sink->path, index);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        ulog_mmap_header_t header;
+        if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                header.magic == ULOG_MMAP_MAGIC && header.seq > sink->seq) {
+            sink->seq = header.seq;
+            sink->index = index;
+        }
+        close(fd);
+    }
+
+    pthread_mutex_init(&sink->mutex, NULL);
+    mmap_segment_t *seg = mmap_segment_prepare(sink);
+    if (seg == NULL) {
+        pthread_mutex_destroy(&sink->mutex);
+        free(sink->path);
+        free(sink);
+        return NULL;
+    }
+    mmap_segment_install(sink, seg);
+    return sink;
+}
+
+void ulog_mmap_sink_destroy(ulog_mmap_sink_t *sink)
+{
+    if (sink == NULL) {
+        return;
+    }
+    mmap_segment_t *current = atomic_load_explicit(&sink->current, memory_order_acquire);
+    if (current != NULL) {
+        mmap_segment_release(sink, current, (off_t) __atomic_load_n(&current->header->end, __ATOMIC_ACQUIRE));
+    }
+    if (sink->next != NULL) {
+        // never written, leave an empty file
+        mmap_segment_release(sink, sink->next, 0);
+    }
+    if (sink->retired != NULL) {
+        mmap_segment_release(sink, sink->retired, -1);
+    }
+    pthread_mutex_destroy(&sink->mutex);
+    free(sink->path);
+    free(sink);
+}
+
+void ulog_mmap_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    (void) level;
+    ulog_mmap_sink_t *sink = (ulog_mmap_sink_t *) ctx;
+    if (len > sink->limit) {
+        return;
+    }
+    while (true) {
+        mmap_segment_t *seg = atomic_load_explicit(&sink->current, memory_order_acquire);
+        if (seg == NULL) {
+            // the last rotation failed, try again without waiting for the poll function
+            if (pthread_mutex_trylock(&sink->mutex) != 0) {
+                return;
+            }
+            if (atomic_load_explicit(&sink->current, memory_order_relaxed) == NULL) {
+                mmap_segment_install(sink, mmap_segment_prepare(sink));
+            }
+            pthread_mutex_unlock(&sink->mutex);
+            if (atomic_load_explicit(&sink->current, memory_order_relaxed) == NULL) {
+                return;
+            }
+            continue;
+        }
+        size_t start = atomic_fetch_add_explicit(&seg->reserved, len, memory_order_relaxed);
+        bool fits = start + len <= sink->limit;
+        if (fits) {
+            memcpy((char *) seg->header + MMAP_HEADER_SIZE + start, buf, len);
+        }
+        if (fits || start <= sink->limit) {
+            // publish in the order of the reservations
+            uint64_t offset = MMAP_HEADER_SIZE + start;
+            while (__atomic_load_n(&seg->header->end, __ATOMIC_ACQUIRE) != offset) {
+                ulog_impl_yield();
+            }
+            if (fits) {
+                __atomic_store_n(&seg->header->end, offset + len, __ATOMIC_RELEASE);
+                return;
+            }
+            mmap_sink_rotate(sink, seg);
+        } else {
+            while (atomic_load_explicit(&sink->current, memory_order_acquire) == seg) {
+                ulog_impl_yield();
+            }
+        }
+    }
+}
+
+void ulog_mmap_sink_poll(void *ctx)
+{
+    ulog_mmap_sink_t *sink = (ulog_mmap_sink_t *) ctx;
+    pthread_mutex_lock(&sink->mutex);
+    if (sink->retired != NULL) {
+        mmap_segment_release(sink, sink->retired, -1);
+        sink->retired = NULL;
+    }
+    if (sink->next == NULL) {
+        sink->next = mmap_segment_prepare(sink);
+    }
+    if (sink->next != NULL && atomic_load_explicit(&sink->current, memory_order_relaxed) == NULL) {
+        mmap_segment_install(sink, sink->next);
+        sink->next = NULL;
+    }
+    pthread_mutex_unlock(&sink->mutex);
 }
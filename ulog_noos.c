@@ -2,6 +2,7 @@
 #include "ulog_private.h"
 
 static int s_lock = 0;
+static void *s_ctx = NULL;
 
 void ulog_impl_lock(void)
 {
@@ -19,6 +20,55 @@ void ulog_impl_unlock(void)
     s_lock = 0;
 }
 
+void *ulog_impl_thread_ctx_get(void)
+{
+    return s_ctx;
+}
+
+bool ulog_impl_thread_ctx_set(void *ctx)
+{
+    s_ctx = ctx;
+    return true;
+}
+
+/* There is no background task without an OS, log entries are written synchronously */
+bool ulog_impl_async_start(void (*task)(void *), void *arg)
+{
+    (void) task;
+    (void) arg;
+    return false;
+}
+
+void ulog_impl_async_wait(uint32_t timeout_ms)
+{
+    (void) timeout_ms;
+}
+
+void ulog_impl_async_notify(void)
+{
+}
+
+void ulog_impl_yield(void)
+{
+}
+
+unsigned ulog_impl_shard(void)
+{
+    return 0;
+}
+
+uint32_t ulog_impl_time_us(void)
+{
+    return 0;
+}
+
+#if CONFIG_LOG_PROFILE
+uint32_t ulog_impl_cycles(void)
+{
+    return 0;
+}
+#endif
+
 /* FIXME: define an API for getting the timestamp in soc/hal IDF-2351 */
 uint32_t ulog_early_timestamp(void)
 {
@@ -1,6 +1,260 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include "ulog.h"
 
 void ulog_impl_lock(void);
 bool ulog_impl_lock_timeout(void);
 void ulog_impl_unlock(void);
+
+/* Thread local pointer, ulog_ctx_release() is called with the pointer when the thread
+   exits. Setting it fails in contexts which are not a thread, e.g. an ISR. */
+void *ulog_impl_thread_ctx_get(void);
+bool ulog_impl_thread_ctx_set(void *ctx);
+
+/* Free the log context of a thread, see ulog_impl_thread_ctx_set() */
+void ulog_ctx_release(void *ctx);
+
+/* Per-thread state of the library, allocated on the first log entry of a thread */
+typedef struct {
+    void *async_ring;       // ring of the asynchronous output, see ulog_async.c
+    bool busy;              // line is in use, an entry is logged from a sink
+    int64_t timestamp_sec;  // second formatted in the timestamp prefix, 0 if none
+    char timestamp[32];     // returned by ulog_system_timestamp()
+    char line[CONFIG_LOG_LINE_BUFFER_SIZE];
+} ulog_ctx_t;
+
+/* Log context of the calling thread, NULL if it has none (ISR, out of memory) */
+ulog_ctx_t *ulog_ctx_get(void);
+
+/* Background drain task of the asynchronous output, see ulog_async.c */
+bool ulog_impl_async_start(void (*task)(void *), void *arg);
+void ulog_impl_async_wait(uint32_t timeout_ms);
+void ulog_impl_async_notify(void);
+void ulog_impl_yield(void);
+
+/* Index of the CPU, or of the thread, running the caller. Spreads the statistics
+   counters, any value is correct. */
+unsigned ulog_impl_shard(void);
+
+/* Monotonic time in microseconds, wrapping around, 0 if there is no such clock */
+uint32_t ulog_impl_time_us(void);
+
+#if CONFIG_LOG_PROFILE
+/* Cycle counter of the CPU, wrapping around, 0 if there is none */
+uint32_t ulog_impl_cycles(void);
+
+/* Count an entry of a tag in its profile slot, see ulog_profile.c */
+void ulog_profile_entry(const char *tag, size_t len, uint32_t format_cycles, uint32_t sink_cycles);
+void ulog_profile_filtered(const char *tag);
+
+static inline uint32_t ulog_profile_cycles(void)
+{
+    return ulog_impl_cycles();
+}
+#else
+static inline uint32_t ulog_profile_cycles(void)
+{
+    return 0;
+}
+
+static inline void ulog_profile_entry(const char *tag, size_t len, uint32_t format_cycles, uint32_t sink_cycles)
+{
+    (void) tag;
+    (void) len;
+    (void) format_cycles;
+    (void) sink_cycles;
+}
+
+static inline void ulog_profile_filtered(const char *tag)
+{
+    (void) tag;
+}
+#endif
+
+/* Counters of ulog_get_stats(), one copy per shard, see ulog_stats.c */
+typedef struct {
+    uint32_t emitted[ULOG_VERBOSE + 1];
+    uint32_t filtered[ULOG_VERBOSE + 1];
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t lock_timeouts;
+    size_t sink_bytes[CONFIG_LOG_SINK_MAX];
+} __attribute__((aligned(64))) ulog_stats_shard_t;
+
+extern ulog_stats_shard_t ulog_stats_shards[CONFIG_LOG_STATS_SHARDS];
+
+#define ULOG_STATS_ADD(field, value) \
+    __atomic_add_fetch(&ulog_stats_shards[ulog_impl_shard() & (CONFIG_LOG_STATS_SHARDS - 1)].field, (value), __ATOMIC_RELAXED)
+
+#define ULOG_STATS_INC(field) ULOG_STATS_ADD(field, 1)
+
+/* Record the duration of a call to the write function of a sink */
+void ulog_stats_sink_latency(int id, uint32_t latency_us);
+
+/* Write already formatted text with the output function set by ulog_set_vprintf() */
+void ulog_print_raw(const char *buf, size_t len);
+
+/* Write function of the ULOG_SINK_CONSOLE sink, calls ulog_print_raw() */
+void ulog_console_write(void *ctx, ulog_level_t level, const char *buf, size_t len);
+
+/* Level of a tag, without taking the lock nor filling the cache */
+ulog_level_t ulog_level_lookup(const char *tag);
+
+/* Write an already formatted entry to the backtrace store and the sinks accepting it */
+void ulog_output_text(ulog_level_t level, const char *tag, const char *buf, size_t len);
+
+/* Write an entry to the backtrace store if requested and to the sinks of the mask */
+void ulog_dispatch(ulog_level_t level, uint32_t sinks, bool backtrace, const char *buf, size_t len);
+
+/* Recompute ulog_max_level after a change of the sinks or backtrace levels, takes ulog_impl_lock() */
+void ulog_max_level_refresh(void);
+
+/* Most verbose level accepted by any sink, see ulog_sink.c */
+ulog_level_t ulog_sinks_max_level(void);
+
+/* Mask of the sinks accepting an entry, bit n is set for sink id n */
+uint32_t ulog_sinks_accept(ulog_level_t level, const char *tag);
+
+/* Mask of the structured sinks, which only receive ULOG_KV() records */
+uint32_t ulog_sinks_structured(void);
+
+/* Pass formatted text to every sink of the mask */
+void ulog_sinks_write(uint32_t sinks, ulog_level_t level, const char *buf, size_t len);
+
+/* Call the poll function of every sink, from the drain task */
+void ulog_sinks_poll(void);
+
+#if CONFIG_LOG_BACKTRACE
+/* Level of the entries kept in the backtrace store */
+ulog_level_t ulog_backtrace_level(void);
+
+/* Store the formatted log entry in the backtrace store if its level is enabled there */
+void ulog_backtrace_write(ulog_level_t level, const char *buf, size_t len);
+
+/* Store the arguments of a log entry in the backtrace store as a binary record,
+   formatted when the entry is read. Used when no sink takes the entry. */
+void ulog_backtrace_writev(ulog_level_t level, const char *tag, const char *format, va_list args);
+#endif
+
+#if CONFIG_LOG_ASYNC
+/* Queue the formatted log entry for the sinks of the mask if the asynchronous output
+   is running. Returns false if the entry must be written synchronously by the caller. */
+bool ulog_async_write(ulog_level_t level, uint32_t sinks, const char *buf, size_t len);
+
+/* Called when the thread owning the ring exits */
+void ulog_async_ring_release(void *ring);
+
+/* Wake up the drain task, can be called from an ISR */
+void ulog_async_wake(void);
+#endif
+
+#if CONFIG_LOG_ISR
+/* Write the entries of the interrupt handlers, called by the drain task */
+void ulog_isr_drain(void);
+#endif
+
+#if CONFIG_LOG_FILTER
+/* Verdict of the keyword filters on the format of a text entry */
+typedef enum {
+    ULOG_FILTER_PASS,
+    ULOG_FILTER_DROP,
+    ULOG_FILTER_TEXT,   // depends on the arguments, see ulog_filter_text()
+} ulog_filter_verdict_t;
+
+ulog_filter_verdict_t ulog_filter_format(const char *format);
+
+/* Verdict of the keyword filters on the formatted entry, true to write it */
+bool ulog_filter_text(const char *format, const char *text, size_t len);
+#endif
+
+/* Formatter of the text entries */
+#if CONFIG_LOG_VSNPRINTF
+#define ulog_format_vsnprintf   ulog_vsnprintf
+#define ulog_format_snprintf    ulog_snprintf
+#else
+#define ulog_format_vsnprintf   vsnprintf
+#define ulog_format_snprintf    snprintf
+#endif
+
+/* "00".."99", two characters per value */
+extern const char ulog_digit_pairs[200];
+
+/* Write value as exactly digits decimal digits with leading zeros, returns the end */
+char *ulog_put_digits(char *p, uint32_t value, int digits);
+
+/* Prefix of a text entry, see LOG_FORMAT() */
+typedef struct {
+    ulog_level_t level;
+    bool has_timestamp;     // false with the system time
+    uint32_t timestamp;     // in milliseconds
+    const char *tag;        // not zero terminated
+    size_t tag_len;
+} ulog_entry_prefix_t;
+
+/* Split the prefix of a text entry, returns false if it does not have the layout of LOG_FORMAT() */
+bool ulog_entry_parse(const char *text, size_t len, ulog_entry_prefix_t *prefix);
+
+/* FNV-1a hash of a tag of len characters */
+static inline uint32_t ulog_tag_hash_n(const char *tag, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (uint8_t) tag[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Type of the argument consumed by a printf conversion */
+typedef enum {
+    ULOG_ARG_NONE,      // "%%", no argument
+    ULOG_ARG_INT,       // int and promoted types: char, short, %c
+    ULOG_ARG_LONG,
+    ULOG_ARG_LLONG,
+    ULOG_ARG_INTMAX,
+    ULOG_ARG_SIZE,
+    ULOG_ARG_PTRDIFF,
+    ULOG_ARG_PTR,       // %p, and %n whose target is never written
+    ULOG_ARG_DOUBLE,
+    ULOG_ARG_LDOUBLE,
+    ULOG_ARG_STR,
+} ulog_arg_type_t;
+
+/* One conversion of a printf format string */
+typedef struct {
+    const char *start;      // the '%' of the conversion
+    const char *end;        // one past the conversion character
+    char conversion;        // conversion character, e.g. 'd', 's' or '%'
+    ulog_arg_type_t type;   // type of the converted argument
+    bool width_arg;         // width given as '*', an int argument comes first
+    bool precision_arg;     // precision given as '*', an int argument comes first
+    int precision;          // precision given in the format, -1 if none
+} ulog_fmt_spec_t;
+
+/* Find the next conversion of a format string and advance *format past it.
+   Returns false when there is no conversion left. */
+bool ulog_fmt_next(const char **format, ulog_fmt_spec_t *spec);
+
+/* Encode a binary record (see ulog_set_binary_output()) into buf, returns its length */
+size_t ulog_binary_encode(void *buf, size_t size, ulog_level_t level, const char *tag,
+                          const char *format, va_list args);
+
+/* Fields of a binary record, pointing into the record or into the sections */
+typedef struct {
+    ulog_level_t level;
+    bool truncated;
+    uint32_t timestamp;
+    const char *tag;
+    const char *format;
+    const uint8_t *args;    // packed arguments
+    const uint8_t *end;     // end of the record
+} ulog_binary_record_t;
+
+/* Split a binary record into its fields, returns false if it is malformed */
+bool ulog_binary_decode(const void *data, size_t len, ulog_binary_record_t *record);
+
+/* Format the text of a decoded record into buf like snprintf(), returns
+   the length of the text written. */
+size_t ulog_binary_format(char *buf, size_t size, const ulog_binary_record_t *record);
@@ -0,0 +1,185 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_PROFILE
+
+#define PROFILE_SLOTS CONFIG_LOG_PROFILE_TAGS
+
+_Static_assert((PROFILE_SLOTS & (PROFILE_SLOTS - 1)) == 0, "CONFIG_LOG_PROFILE_TAGS must be a power of 2");
+
+/* Open-addressing table keyed on the tag pointer, as is the tag cache. A slot is
+   claimed by setting its tag with a compare-and-swap and never released, so that
+   it can be found and updated without any lock. Tags with the same name at several
+   addresses get one slot per address, merged by ulog_profile_get().
+*/
+typedef struct {
+    const char *tag;        // NULL if the slot is free
+    uint32_t count;
+    uint32_t filtered;
+    size_t bytes;
+    uint64_t format_cycles;
+    uint64_t sink_cycles;
+} profile_slot_t;
+
+static profile_slot_t s_slots[PROFILE_SLOTS];
+
+#define ADD(field, value)   __atomic_add_fetch(&(field), (value), __ATOMIC_RELAXED)
+#define LOAD(field)         __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static profile_slot_t *slot_for(const char *tag)
+{
+    if (tag == NULL) {
+        return NULL;
+    }
+    uint32_t i = ((uint32_t) (uintptr_t) tag * 2654435761u) >> 16;
+    for (uint32_t probe = 0; probe < PROFILE_SLOTS; ++probe, ++i) {
+        profile_slot_t *slot = &s_slots[i & (PROFILE_SLOTS - 1)];
+        const char *slot_tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (slot_tag == NULL) {
+            if (__atomic_compare_exchange_n(&slot->tag, &slot_tag, tag, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return slot;
+            }
+            // claimed by another thread meanwhile, slot_tag is its tag
+        }
+        if (slot_tag == tag) {
+            return slot;
+        }
+    }
+    return NULL;    // table full
+}
+
+void ulog_profile_entry(const char *tag, size_t len, uint32_t format_cycles, uint32_t sink_cycles)
+{
+    profile_slot_t *slot = slot_for(tag);
+    if (slot) {
+        ADD(slot->count, 1);
+        ADD(slot->bytes, len);
+        ADD(slot->format_cycles, format_cycles);
+        ADD(slot->sink_cycles, sink_cycles);
+    }
+}
+
+void ulog_profile_filtered(const char *tag)
+{
+    profile_slot_t *slot = slot_for(tag);
+    if (slot) {
+        ADD(slot->filtered, 1);
+    }
+}
+
+static inline void slot_add(ulog_profile_t *profile, const profile_slot_t *slot)
+{
+    profile->count += LOAD(slot->count);
+    profile->filtered += LOAD(slot->filtered);
+    profile->bytes += LOAD(slot->bytes);
+    profile->format_cycles += LOAD(slot->format_cycles);
+    profile->sink_cycles += LOAD(slot->sink_cycles);
+}
+
+static inline uint64_t profile_cost(const ulog_profile_t *profile)
+{
+    return profile->format_cycles + profile->sink_cycles;
+}
+
+size_t ulog_profile_get(ulog_profile_t *tags, size_t count)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < PROFILE_SLOTS; ++i) {
+        const char *tag = __atomic_load_n(&s_slots[i].tag, __ATOMIC_ACQUIRE);
+        if (tag == NULL) {
+            continue;
+        }
+        // the first slot of a name sums the others
+        bool merged = false;
+        for (size_t j = 0; j < i && !merged; ++j) {
+            const char *other = __atomic_load_n(&s_slots[j].tag, __ATOMIC_ACQUIRE);
+            merged = other != NULL && strcmp(other, tag) == 0;
+        }
+        if (merged) {
+            continue;
+        }
+        ulog_profile_t profile = { .tag = tag };
+        slot_add(&profile, &s_slots[i]);
+        for (size_t j = i + 1; j < PROFILE_SLOTS; ++j) {
+            const char *other = __atomic_load_n(&s_slots[j].tag, __ATOMIC_ACQUIRE);
+            if (other != NULL && strcmp(other, tag) == 0) {
+                slot_add(&profile, &s_slots[j]);
+            }
+        }
+        // insertion into the most costly count tags
+        size_t pos = found < count ? found++ : count;
+        while (pos > 0 && profile_cost(&tags[pos - 1]) < profile_cost(&profile)) {
+            if (pos < count) {
+                tags[pos] = tags[pos - 1];
+            }
+            --pos;
+        }
+        if (pos < count) {
+            tags[pos] = profile;
+        }
+    }
+    return found;
+}
+
+void ulog_profile_dump(size_t count)
+{
+    if (count == 0 || count > PROFILE_SLOTS) {
+        count = PROFILE_SLOTS;
+    }
+    ulog_profile_t *tags = (ulog_profile_t *) malloc(count * sizeof(ulog_profile_t));
+    if (tags == NULL) {
+        return;
+    }
+    count = ulog_profile_get(tags, count);
+    char line[128];
+    int len = ulog_format_snprintf(line, sizeof(line), "%-20s %10s %10s %12s %14s %14s\n",
+                                   "tag", "count", "filtered", "bytes", "format cycles", "sink cycles");
+    ulog_print_raw(line, (size_t) len);
+    for (size_t i = 0; i < count; ++i) {
+        const ulog_profile_t *profile = &tags[i];
+        len = ulog_format_snprintf(line, sizeof(line), "%-20.20s %10" PRIu32 " %10" PRIu32 " %12zu %14" PRIu64
+                                   " %14" PRIu64 "\n", profile->tag, profile->count, profile->filtered,
+                                   profile->bytes, profile->format_cycles, profile->sink_cycles);
+        ulog_print_raw(line, (size_t) len);
+    }
+    free(tags);
+}
+
+void ulog_profile_reset(void)
+{
+    // increments racing with the reset may survive it
+    for (size_t i = 0; i < PROFILE_SLOTS; ++i) {
+        profile_slot_t *slot = &s_slots[i];
+        __atomic_store_n(&slot->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->filtered, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->format_cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->sink_cycles, 0, __ATOMIC_RELAXED);
+    }
+}
+
+#else
+
+size_t ulog_profile_get(ulog_profile_t *tags, size_t count)
+{
+    (void) tags;
+    (void) count;
+    return 0;
+}
+
+void ulog_profile_dump(size_t count)
+{
+    (void) count;
+}
+
+void ulog_profile_reset(void)
+{
+}
+
+#endif // CONFIG_LOG_PROFILE
@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_RATE_LIMIT
+
+static uint32_t s_suppressed;
+
+/* Call sites with entries suppressed since their last refill, so that the counts are
+   written by ulog_suppressed_flush() even if the call site does not log again. A slot
+   is claimed by setting its site with a compare-and-swap, and ready once its tag and
+   level are set. Sites found once the table is full are reported on their next refill
+   only. */
+typedef struct {
+    ulog_site_t *site;
+    const char *tag;
+    uint8_t level;
+    bool ready;
+} pending_t;
+
+static pending_t s_pending[CONFIG_LOG_RATE_LIMIT_PENDING];
+static bool s_flushing;
+static bool s_exit_registered;
+
+static void pending_add(ulog_site_t *site, ulog_level_t level, const char *tag)
+{
+    if (!__atomic_test_and_set(&s_exit_registered, __ATOMIC_RELAXED)) {
+        atexit(&ulog_suppressed_flush);
+    }
+    for (size_t i = 0; i < CONFIG_LOG_RATE_LIMIT_PENDING; ++i) {
+        pending_t *pending = &s_pending[i];
+        ulog_site_t *expected = NULL;
+        if (__atomic_compare_exchange_n(&pending->site, &expected, site, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            pending->tag = tag;
+            pending->level = (uint8_t) level;
+            __atomic_store_n(&pending->ready, true, __ATOMIC_RELEASE);
+            return;
+        }
+        if (expected == site) {
+            return;     // already pending
+        }
+    }
+}
+
+bool ulog_site_refill(ulog_site_t *site, ulog_level_t level, const char *tag)
+{
+    uint32_t now = ulog_timestamp();
+    if (now == 0) {
+        // no clock yet (noos, or before the scheduler starts): no limit, give the token back
+        __atomic_add_fetch(&site->tokens, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    /* refill_ts starts at 0, the bucket was full at startup: the first refill of a
+       call site busy since a while lets up to two bursts through */
+    uint32_t last = __atomic_load_n(&site->refill_ts, __ATOMIC_RELAXED);
+    uint64_t tokens = (uint64_t) (now - last) * CONFIG_LOG_RATE_LIMIT_PER_SEC / 1000;
+
+    // a single caller refills the bucket, the others lose the race and are dropped
+    if (tokens == 0 || !__atomic_compare_exchange_n(&site->refill_ts, &last, now, false,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        if (__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED) == 1) {
+            pending_add(site, level, tag);
+        }
+        __atomic_add_fetch(&s_suppressed, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    if (tokens > CONFIG_LOG_RATE_LIMIT_BURST) {
+        tokens = CONFIG_LOG_RATE_LIMIT_BURST;
+    }
+    /* Entries which took the bucket below zero were dropped, the tokens are added to
+       an empty bucket minus the token of this entry. Tokens taken meanwhile by other
+       callers make the exchange fail and are kept. */
+    int32_t cur = __atomic_load_n(&site->tokens, __ATOMIC_RELAXED);
+    int32_t next;
+    do {
+        next = (cur > 0 ? cur : 0) + (int32_t) tokens - 1;
+        if (next > CONFIG_LOG_RATE_LIMIT_BURST - 1) {
+            next = CONFIG_LOG_RATE_LIMIT_BURST - 1;
+        }
+    } while (!__atomic_compare_exchange_n(&site->tokens, &cur, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint32_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    if (suppressed) {
+        ULOG_LEVEL_UNCHECKED(level, tag, "%" PRIu32 " similar entries suppressed", suppressed);
+    }
+    return true;
+}
+
+void ulog_suppressed_flush(void)
+{
+    if (__atomic_test_and_set(&s_flushing, __ATOMIC_ACQUIRE)) {
+        return;     // flushed by another thread
+    }
+    for (size_t i = 0; i < CONFIG_LOG_RATE_LIMIT_PENDING; ++i) {
+        pending_t *pending = &s_pending[i];
+        if (!__atomic_load_n(&pending->ready, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        ulog_site_t *site = pending->site;
+        const char *tag = pending->tag;
+        ulog_level_t level = (ulog_level_t) pending->level;
+        __atomic_store_n(&pending->ready, false, __ATOMIC_RELAXED);
+        __atomic_store_n(&pending->site, NULL, __ATOMIC_RELEASE);
+        // the next entry suppressed claims a slot again
+        uint32_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+        if (suppressed) {
+            ULOG_LEVEL_UNCHECKED(level, tag, "%" PRIu32 " similar entries suppressed", suppressed);
+        }
+    }
+    __atomic_clear(&s_flushing, __ATOMIC_RELEASE);
+}
+
+uint32_t ulog_suppressed(void)
+{
+    return __atomic_load_n(&s_suppressed, __ATOMIC_RELAXED);
+}
+
+#else
+
+void ulog_suppressed_flush(void)
+{
+}
+
+uint32_t ulog_suppressed(void)
+{
+    return 0;
+}
+
+#endif // CONFIG_LOG_RATE_LIMIT
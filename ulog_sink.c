@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+_Static_assert(CONFIG_LOG_SINK_MAX <= 32, "sinks are selected with a 32-bit mask");
+
+/* Slots are written under ulog_impl_lock() and read without it, a slot is in use
+   while its write function is not NULL.
+*/
+typedef struct {
+    _Atomic(ulog_sink_write_t) write;
+    ulog_sink_poll_t poll;
+    void *ctx;
+    atomic_uchar level;
+    char tag_filter[ULOG_TAG_NAME_MAX + 2];
+} sink_slot_t;
+
+static sink_slot_t s_sinks[CONFIG_LOG_SINK_MAX] = {
+    [ULOG_SINK_CONSOLE] = {
+        .write = &ulog_console_write,
+        .level = ULOG_VERBOSE,
+    },
+};
+
+// one past the highest slot in use
+static atomic_int s_sink_end = 1;
+
+// mask of the slots in use by structured sinks
+static atomic_uint s_structured_sinks;
+
+int ulog_sink_add(const ulog_sink_config_t *config)
+{
+    ulog_impl_lock();
+    for (int id = 0; id < CONFIG_LOG_SINK_MAX; ++id) {
+        sink_slot_t *slot = &s_sinks[id];
+        if (atomic_load_explicit(&slot->write, memory_order_relaxed) != NULL) {
+            continue;
+        }
+        slot->ctx = config->ctx;
+        slot->poll = config->poll;
+        atomic_store_explicit(&slot->level, (uint8_t) config->level, memory_order_relaxed);
+        slot->tag_filter[0] = '\0';
+        if (config->tag_filter) {
+            strncat(slot->tag_filter, config->tag_filter, sizeof(slot->tag_filter) - 1);
+        }
+        atomic_store_explicit(&slot->write, config->write, memory_order_release);
+        if (config->structured) {
+            atomic_fetch_or_explicit(&s_structured_sinks, 1u << id, memory_order_relaxed);
+        } else {
+            atomic_fetch_and_explicit(&s_structured_sinks, ~(1u << id), memory_order_relaxed);
+        }
+        if (id >= atomic_load_explicit(&s_sink_end, memory_order_relaxed)) {
+            atomic_store_explicit(&s_sink_end, id + 1, memory_order_release);
+        }
+        ulog_impl_unlock();
+        ulog_max_level_refresh();
+        return id;
+    }
+    ulog_impl_unlock();
+    return -1;
+}
+
+void ulog_sink_remove(int id)
+{
+    if (id < 0 || id >= CONFIG_LOG_SINK_MAX) {
+        return;
+    }
+    ulog_impl_lock();
+    atomic_store_explicit(&s_sinks[id].write, NULL, memory_order_release);
+    ulog_impl_unlock();
+    ulog_max_level_refresh();
+}
+
+void ulog_sink_level_set(int id, ulog_level_t level)
+{
+    if (id < 0 || id >= CONFIG_LOG_SINK_MAX) {
+        return;
+    }
+    atomic_store_explicit(&s_sinks[id].level, (uint8_t) level, memory_order_relaxed);
+    ulog_max_level_refresh();
+}
+
+ulog_level_t ulog_sinks_max_level(void)
+{
+    ulog_level_t max_level = ULOG_NONE;
+    int end = atomic_load_explicit(&s_sink_end, memory_order_acquire);
+    for (int id = 0; id < end; ++id) {
+        if (atomic_load_explicit(&s_sinks[id].write, memory_order_relaxed) == NULL) {
+            continue;
+        }
+        ulog_level_t level = (ulog_level_t) atomic_load_explicit(&s_sinks[id].level, memory_order_relaxed);
+        if (level > max_level) {
+            max_level = level;
+        }
+    }
+    return max_level;
+}
+
+static inline bool tag_matches(const char *filter, const char *tag)
+{
+    if (filter[0] == '\0') {
+        return true;
+    }
+    size_t len = strlen(filter);
+    if (filter[len - 1] == '*') {
+        return strncmp(filter, tag, len - 1) == 0;
+    }
+    return strcmp(filter, tag) == 0;
+}
+
+uint32_t ulog_sinks_structured(void)
+{
+    return atomic_load_explicit(&s_structured_sinks, memory_order_relaxed);
+}
+
+uint32_t ulog_sinks_accept(ulog_level_t level, const char *tag)
+{
+    uint32_t sinks = 0;
+    int end = atomic_load_explicit(&s_sink_end, memory_order_acquire);
+    for (int id = 0; id < end; ++id) {
+        const sink_slot_t *slot = &s_sinks[id];
+        if (atomic_load_explicit(&slot->write, memory_order_acquire) != NULL &&
+                level <= atomic_load_explicit(&slot->level, memory_order_relaxed) &&
+                tag_matches(slot->tag_filter, tag)) {
+            sinks |= 1u << id;
+        }
+    }
+    return sinks;
+}
+
+void ulog_sinks_write(uint32_t sinks, ulog_level_t level, const char *buf, size_t len)
+{
+    while (sinks) {
+        int id = __builtin_ctz(sinks);
+        sinks &= sinks - 1;
+        const sink_slot_t *slot = &s_sinks[id];
+        ulog_sink_write_t write = atomic_load_explicit(&slot->write, memory_order_acquire);
+        if (write) {
+            uint32_t start = ulog_impl_time_us();
+            write(slot->ctx, level, buf, len);
+            ulog_stats_sink_latency(id, ulog_impl_time_us() - start);
+            ULOG_STATS_ADD(sink_bytes[id], len);
+        }
+    }
+}
+
+void ulog_sinks_poll(void)
+{
+    int end = atomic_load_explicit(&s_sink_end, memory_order_acquire);
+    for (int id = 0; id < end; ++id) {
+        const sink_slot_t *slot = &s_sinks[id];
+        if (atomic_load_explicit(&slot->write, memory_order_acquire) != NULL && slot->poll != NULL) {
+            slot->poll(slot->ctx);
+        }
+    }
+}
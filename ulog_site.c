@@ -0,0 +1,85 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+#if CONFIG_LOG_SITES
+
+/* Sites above LOG_LOCAL_LEVEL are dead code, though GCC keeps them at -O0 */
+static inline bool site_compiled(const ulog_site_t *site)
+{
+    return site->level <= site->local_level;
+}
+
+/* Does path end with file, from the start of a path component? */
+static bool file_matches(const char *path, const char *file)
+{
+    size_t path_len = strlen(path);
+    size_t file_len = strlen(file);
+    if (file_len > path_len || strcmp(path + path_len - file_len, file) != 0) {
+        return false;
+    }
+    if (file_len == path_len || file[0] == '/') {
+        return true;
+    }
+    char before = path[path_len - file_len - 1];
+    return before == '/' || before == '\\';
+}
+
+static bool site_matches(const ulog_site_t *site, const char *file, uint32_t first_line, uint32_t last_line,
+                         const char *format)
+{
+    if (!site_compiled(site) || site->line < first_line || (last_line != 0 && site->line > last_line)) {
+        return false;
+    }
+    if (format != NULL && (site->format == NULL || strstr(site->format, format) == NULL)) {
+        return false;
+    }
+    return file == NULL || file_matches(site->file, file);
+}
+
+size_t ulog_sites_set(const char *file, uint32_t first_line, uint32_t last_line, const char *format,
+                      ulog_site_mode_t mode)
+{
+    size_t count = 0;
+    ulog_impl_lock();
+    for (ulog_site_t *site = __start_ulog_sites; site < __stop_ulog_sites; ++site) {
+        if (site_matches(site, file, first_line, last_line, format)) {
+            __atomic_store_n(&site->mode, (uint8_t) mode, __ATOMIC_RELAXED);
+            ++count;
+        }
+    }
+    ulog_impl_unlock();
+    return count;
+}
+
+void ulog_sites_foreach(bool (*fn)(const ulog_site_t *site, void *arg), void *arg)
+{
+    for (const ulog_site_t *site = __start_ulog_sites; site < __stop_ulog_sites; ++site) {
+        if (site_compiled(site) && !fn(site, arg)) {
+            break;
+        }
+    }
+}
+
+#else
+
+size_t ulog_sites_set(const char *file, uint32_t first_line, uint32_t last_line, const char *format,
+                      ulog_site_mode_t mode)
+{
+    (void) file;
+    (void) first_line;
+    (void) last_line;
+    (void) format;
+    (void) mode;
+    return 0;
+}
+
+void ulog_sites_foreach(bool (*fn)(const ulog_site_t *site, void *arg), void *arg)
+{
+    (void) fn;
+    (void) arg;
+}
+
+#endif // CONFIG_LOG_SITES
@@ -0,0 +1,104 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+_Static_assert((CONFIG_LOG_STATS_SHARDS & (CONFIG_LOG_STATS_SHARDS - 1)) == 0,
+               "CONFIG_LOG_STATS_SHARDS must be a power of 2");
+
+ulog_stats_shard_t ulog_stats_shards[CONFIG_LOG_STATS_SHARDS];
+
+static uint32_t s_sink_max_latency_us[CONFIG_LOG_SINK_MAX];
+
+// values at the last ulog_reset_stats() of the counters kept by their own module
+static uint32_t s_suppressed_base;
+static uint32_t s_async_dropped_base;
+static uint32_t s_isr_dropped_base;
+
+#define LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define CLEAR(var) __atomic_store_n(&(var), 0, __ATOMIC_RELAXED)
+
+void ulog_stats_sink_latency(int id, uint32_t latency_us)
+{
+    uint32_t max = LOAD(s_sink_max_latency_us[id]);
+    while (latency_us > max &&
+            !__atomic_compare_exchange_n(&s_sink_max_latency_us[id], &max, latency_us, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static uint32_t suppressed(void)
+{
+#if CONFIG_LOG_RATE_LIMIT
+    return ulog_suppressed();
+#else
+    return 0;
+#endif
+}
+
+static uint32_t async_dropped(void)
+{
+#if CONFIG_LOG_ASYNC
+    return ulog_async_dropped();
+#else
+    return 0;
+#endif
+}
+
+static uint32_t isr_dropped(void)
+{
+#if CONFIG_LOG_ISR
+    return ulog_isr_dropped();
+#else
+    return 0;
+#endif
+}
+
+void ulog_get_stats(ulog_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int shard = 0; shard < CONFIG_LOG_STATS_SHARDS; ++shard) {
+        const ulog_stats_shard_t *counters = &ulog_stats_shards[shard];
+        for (int level = 0; level <= ULOG_VERBOSE; ++level) {
+            stats->emitted[level] += LOAD(counters->emitted[level]);
+            stats->filtered[level] += LOAD(counters->filtered[level]);
+        }
+        stats->cache_hits += LOAD(counters->cache_hits);
+        stats->cache_misses += LOAD(counters->cache_misses);
+        stats->lock_timeouts += LOAD(counters->lock_timeouts);
+        for (int id = 0; id < CONFIG_LOG_SINK_MAX; ++id) {
+            stats->sink_bytes[id] += LOAD(counters->sink_bytes[id]);
+        }
+    }
+    for (int id = 0; id < CONFIG_LOG_SINK_MAX; ++id) {
+        stats->sink_max_latency_us[id] = LOAD(s_sink_max_latency_us[id]);
+    }
+    stats->suppressed = suppressed() - LOAD(s_suppressed_base);
+    stats->async_dropped = async_dropped() - LOAD(s_async_dropped_base);
+    stats->isr_dropped = isr_dropped() - LOAD(s_isr_dropped_base);
+}
+
+void ulog_reset_stats(void)
+{
+    // increments racing with the reset may survive it
+    for (int shard = 0; shard < CONFIG_LOG_STATS_SHARDS; ++shard) {
+        ulog_stats_shard_t *counters = &ulog_stats_shards[shard];
+        for (int level = 0; level <= ULOG_VERBOSE; ++level) {
+            CLEAR(counters->emitted[level]);
+            CLEAR(counters->filtered[level]);
+        }
+        CLEAR(counters->cache_hits);
+        CLEAR(counters->cache_misses);
+        CLEAR(counters->lock_timeouts);
+        for (int id = 0; id < CONFIG_LOG_SINK_MAX; ++id) {
+            CLEAR(counters->sink_bytes[id]);
+        }
+    }
+    for (int id = 0; id < CONFIG_LOG_SINK_MAX; ++id) {
+        CLEAR(s_sink_max_latency_us[id]);
+    }
+    __atomic_store_n(&s_suppressed_base, suppressed(), __ATOMIC_RELAXED);
+    __atomic_store_n(&s_async_dropped_base, async_dropped(), __ATOMIC_RELAXED);
+    __atomic_store_n(&s_isr_dropped_base, isr_dropped(), __ATOMIC_RELAXED);
+}
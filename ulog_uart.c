@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "ulog.h"
+#include "ulog_private.h"
+
+/* The state word is shared with the TX-complete interrupt, which cannot take a lock:
+   it holds the buffer being filled, whether the DMA is sending the other one, and
+   whether a writer is copying into the first one. The interrupt only swaps the
+   buffers while no writer is copying, otherwise it leaves the DMA idle and the
+   writer starts the next transfer once it is done.
+*/
+#define STATE_FILL      0x1     // index of the buffer being filled
+#define STATE_BUSY      0x2     // the DMA is sending the other buffer
+#define STATE_WRITING   0x4     // a writer is copying into the buffer being filled
+
+struct ulog_uart_sink {
+    ulog_uart_sink_config_t config;
+    atomic_uint state;
+    atomic_size_t len[2];       // bytes in every buffer
+    atomic_flag writer;         // serializes the writers, not taken by the interrupt
+    atomic_size_t dropped;
+};
+
+ulog_uart_sink_t *ulog_uart_sink_create(const ulog_uart_sink_config_t *config)
+{
+    ulog_uart_sink_t *sink = calloc(1, sizeof(ulog_uart_sink_t));
+    if (sink == NULL) {
+        return NULL;
+    }
+    sink->config = *config;
+    atomic_flag_clear(&sink->writer);
+    return sink;
+}
+
+void ulog_uart_sink_destroy(ulog_uart_sink_t *sink)
+{
+    free(sink);
+}
+
+/* Send the buffer being filled if the DMA is idle, with the writer flag taken */
+static void start_next(ulog_uart_sink_t *sink)
+{
+    uint32_t state = atomic_load_explicit(&sink->state, memory_order_acquire);
+    if (state & STATE_BUSY) {
+        return;     // the interrupt sends it at the end of the current transfer
+    }
+    // the DMA is idle, no interrupt can come until the transfer below is started
+    unsigned fill = state & STATE_FILL;
+    size_t len = atomic_load_explicit(&sink->len[fill], memory_order_relaxed);
+    if (len == 0) {
+        return;
+    }
+    atomic_store_explicit(&sink->state, (fill ^ 1) | STATE_BUSY, memory_order_release);
+    sink->config.start_tx(sink->config.ctx, sink->config.buffers[fill], len);
+}
+
+void ulog_uart_sink_tx_done(ulog_uart_sink_t *sink)
+{
+    uint32_t state = atomic_load_explicit(&sink->state, memory_order_acquire);
+    // the buffer just sent is filled again from its start
+    atomic_store_explicit(&sink->len[(state & STATE_FILL) ^ 1], 0, memory_order_relaxed);
+    while (true) {
+        unsigned fill = state & STATE_FILL;
+        size_t len = (state & STATE_WRITING) ? 0 : atomic_load_explicit(&sink->len[fill], memory_order_relaxed);
+        if (len == 0) {
+            // nothing to send, or the writer sends it once done
+            if (atomic_compare_exchange_weak_explicit(&sink->state, &state, state & ~STATE_BUSY,
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+                return;
+            }
+        } else if (atomic_compare_exchange_weak_explicit(&sink->state, &state, state ^ STATE_FILL,
+                                                         memory_order_acq_rel, memory_order_acquire)) {
+            sink->config.start_tx(sink->config.ctx, sink->config.buffers[fill], len);
+            return;
+        }
+    }
+}
+
+/* Copy what fits into the buffer being filled, returns the number of bytes copied */
+static size_t copy_entry(ulog_uart_sink_t *sink, const char *buf, size_t len)
+{
+    uint32_t state = atomic_fetch_or_explicit(&sink->state, STATE_WRITING, memory_order_acq_rel);
+    unsigned fill = state & STATE_FILL;
+    size_t used = atomic_load_explicit(&sink->len[fill], memory_order_relaxed);
+    size_t room = sink->config.buffer_size - used;
+    if (len > room) {
+        len = room;
+    }
+    memcpy((char *) sink->config.buffers[fill] + used, buf, len);
+    atomic_store_explicit(&sink->len[fill], used + len, memory_order_relaxed);
+    atomic_fetch_and_explicit(&sink->state, ~STATE_WRITING, memory_order_release);
+    start_next(sink);
+    return len;
+}
+
+static inline size_t fill_len(ulog_uart_sink_t *sink)
+{
+    uint32_t state = atomic_load_explicit(&sink->state, memory_order_acquire);
+    return atomic_load_explicit(&sink->len[state & STATE_FILL], memory_order_relaxed);
+}
+
+void ulog_uart_sink_write(void *ctx, ulog_level_t level, const char *buf, size_t len)
+{
+    (void) level;
+    ulog_uart_sink_t *sink = (ulog_uart_sink_t *) ctx;
+    while (atomic_flag_test_and_set_explicit(&sink->writer, memory_order_acquire)) {
+        ulog_impl_yield();
+    }
+    while (len) {
+        size_t copied = copy_entry(sink, buf, len);
+        buf += copied;
+        len -= copied;
+        if (len == 0) {
+            break;
+        }
+        if (!sink->config.block) {
+            atomic_fetch_add_explicit(&sink->dropped, len, memory_order_relaxed);
+            break;
+        }
+        // both buffers are full, wait for the interrupt to swap them
+        while (fill_len(sink) == sink->config.buffer_size) {
+            ulog_impl_yield();
+        }
+    }
+    atomic_flag_clear_explicit(&sink->writer, memory_order_release);
+}
+
+void ulog_uart_sink_flush(ulog_uart_sink_t *sink)
+{
+    while (atomic_load_explicit(&sink->state, memory_order_acquire) & STATE_BUSY || fill_len(sink) != 0) {
+        ulog_impl_yield();
+    }
+}
+
+size_t ulog_uart_sink_dropped(const ulog_uart_sink_t *sink)
+{
+    return atomic_load_explicit(&sink->dropped, memory_order_relaxed);
+}